@@ -11,12 +11,49 @@
  */
 
 #define CLASS_NAME      "irq_timings"
-#define GPIO_COUNT      100     // only first {GPIO_COUNT} pins will be supported
-#define BUFFER_SIZE     512     // size of buffer for timings
-#define MAX_READ_QUEUE_SIZE 10  // max number of timings in read queue
+#define MAX_GPIO_DEVICES 1024  // max number of gpio pins registered at once
+#define BUFFER_SIZE     512     // default number of timings per read
+#define MAX_ENTRY_SIZE  sizeof(u64) // largest ring entry of any format
+#define STAGING_SIZE    256     // edges staged for irq thread, power of two
+#define STAGING_LEVEL   BIT_ULL(63) // line level bit of a staged timestamp
+#define STAGING_DROP    BIT_ULL(62) // edges were lost before this timestamp
+#define STAGING_MODE    BIT_ULL(61) // capture mode change, level is sampling
+#define MAX_READ_QUEUE_SIZE 10  // default min number of unread reads in ring
+#define RING_SIZE       roundup_pow_of_two(BUFFER_SIZE * MAX_READ_QUEUE_SIZE)
+#define MAX_RING_SIZE   (1U << 22)  // max timings in ring of a gpio
+#define FRAME_FIFO_SIZE 64      // decoded frames kept for readers, power of two
+#define MAX_DECODE_BITS 64      // max data bits of a decoded frame
+#define MAX_MIN_PULSE   NSEC_PER_SEC    // max glitch filter threshold in ns
+#define MAX_TRIGGER_EDGES 4096  // max edges kept before or after a trigger
+#define PULSE_MEAN_SHIFT  16    // fraction bits of the running mean
+#define MAX_PULSE_WIDTH   (1ULL << 46)  // ns, longer widths are clamped
+#define STORM_WINDOW    (10 * NSEC_PER_MSEC)    // ns the edge rate is measured
+#define STORM_HOLDOFF   (100 * NSEC_PER_MSEC)   // ns the irq stays disabled
+#define MIN_STORM_RATE  (NSEC_PER_SEC / STORM_WINDOW)   // edges per second
+#define MIN_SAMPLE_PERIOD (10 * NSEC_PER_USEC)  // ns between storm samples
+#define WRITEBACK_SIZE  (64 * 1024) // bytes per writeback write, page multiple
 #define PERM_WO         0220 // write-only permissions
 #define PERM_RO         0440 // read-only permissions
+#define PERM_RW         0660 // read-write permissions
 #define GPIO_ATTR_PREFIX  "gpio"
+#define GPIO_DEV_PREFIX   "pin" // sysfs name of gpio device, /dev uses gpio
+#define MERGE_DEV_NAME  "all"   // name of the merged device of all pins
+#define MERGE_MINOR     MAX_GPIO_DEVICES    // minor after the gpio minors
+#define MERGE_MAX_PINS  64      // max number of pins merged by one read
+#define MERGE_BUF_SIZE  256     // merged events copied to userspace at once
+#define GROUP_DEV_PREFIX  "group"   // name of the capture group devices
+#define GROUP_MINOR     (MERGE_MINOR + 1)   // minor of capture group 1
+#define SYNC_DEV_NAME   "clock_sync"    // name of the clock sync device
+#define SYNC_MINOR      (GROUP_MINOR + IRQTS_GROUPS)
+#define DEVICE_MINORS   (SYNC_MINOR + 1)
+#define SYNC_RING_SIZE  64      // clock sync records kept, power of two
+#define SYNC_PERIOD     HZ      // jiffies between clock sync records
+#define GROUP_RING_SIZE 4096    // events in the ring of a group, power of two
+#define GROUP_BUF_SIZE  64      // group events copied to userspace at once
+#define PACK_BUF_SIZE   256     // packed timings copied to userspace at once
+#define SHOW_LINE32     11      // longest gpio_show line of a u32 entry
+#define SHOW_LINE64     20      // longest gpio_show line of a u64 entry
+#define VARINT_MAX_SIZE 10      // bytes of the longest u64 LEB128 varint
 
 #include <linux/module.h>
 #include <linux/kernel.h>
@@ -24,200 +61,5187 @@
 #include <linux/cdev.h>
 #include <linux/device.h>
 #include <linux/gpio.h>
+#include <linux/gpio/consumer.h>
+#include <linux/platform_device.h>
+#include <linux/mod_devicetable.h>
+#include <linux/property.h>
 #include <linux/interrupt.h>
 #include <linux/mutex.h>
 #include <linux/ktime.h>
+#include <linux/timekeeping.h>
+#include <linux/log2.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/fs.h>
+#include <linux/kref.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/uaccess.h>
+#include <linux/xarray.h>
+#include <linux/rcupdate.h>
+#include <linux/hrtimer.h>
+#include <linux/cpumask.h>
+#include <linux/math64.h>
+#include <linux/seqlock.h>
+#include <linux/workqueue.h>
+#include <linux/sched.h>
+#include <uapi/linux/sched/types.h>
+#if IS_ENABLED(CONFIG_HTE)
+#include <linux/hte.h>
+#endif
+#if defined(IRQTS_LATENCY_STATS) || defined(IRQTS_BENCH)
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#endif
+#ifdef IRQTS_LATENCY_STATS
+#include <linux/percpu.h>
+#endif
+#ifdef IRQTS_BENCH
+#include <linux/random.h>
+#endif
+
+#include "irq_timings.h"
+
+#define CREATE_TRACE_POINTS
+#include "irq_timings_trace.h"
 
 MODULE_AUTHOR("Enlil Odisho <github@enlilodisho.com>");
 MODULE_DESCRIPTION("Driver for measuring time between interrupts on gpio pins.");
 MODULE_LICENSE("GPL");
 
-static const unsigned long GPIO_ATTR_NAME_SIZE = sizeof(GPIO_ATTR_PREFIX)
-                                                    + sizeof(GPIO_COUNT);
+#define CLASS_ATTR_WRITE(_name) \
+    struct class_attribute class_attr_##_name = __ATTR(_name, PERM_WO, \
+                                                       NULL, _name##_store)
+/* struct representing driver_class. defined below */
+static struct class driver_class;
+/* first device number of the gpio character devices */
+static dev_t driver_devt;
+/* serializes registering and unregistering gpio pins */
+static DEFINE_MUTEX(registry_lock);
+/* registered gpio data keyed by gpio number, and by device minor number.
+ * Looked up under RCU, modified with registry_lock held. */
+static DEFINE_XARRAY(registered_gpios);
+static DEFINE_XARRAY_ALLOC(gpio_minors);
+
+// cache of struct gpio_data, cache line aligned for the staging fields
+static struct kmem_cache* gpio_data_cache;
+
+// merged device of all pins. Irq threads wake up its readers on new edges.
+static struct cdev* merge_cdev;
+static struct device* merge_device;
+static atomic_t merge_readers = ATOMIC_INIT(0);
+static atomic_t merge_seq = ATOMIC_INIT(0);
+// numbers the rings of the pins as they are installed, starting at 1
+static atomic_t ring_generation = ATOMIC_INIT(0);
+static DECLARE_WAIT_QUEUE_HEAD(merge_wait);
+
+/*
+ * struct representing a capture group. The hard irq handlers of the members
+ * are the producers of its ring and serialize on lock, which also keeps the
+ * levels and timestamps in order. Readers keep their own position. The ring
+ * and the device are created when the first pin joins and kept until the
+ * module is removed. Members change with registry_lock held.
+ */
+struct capture_group {
+    raw_spinlock_t lock;
+    struct irqts_group_event* events;   // GROUP_RING_SIZE events
+    u32 head;       // events written so far, runs freely
+    u64 lastTime;   // ns of the newest event
+    u16 levels;     // levels of the members after the newest event
+    u16 used;       // member slots in use
+    enum irqts_clock clock; // capture clock of all members
+    // timestamp source of all members, NULL until the first one started
+    const struct timestamp_source* tsSource;
+    unsigned int gpios[IRQTS_GROUP_PINS];
+    wait_queue_head_t wait;
+    struct cdev* cdev;
+    struct device* device;
+};
+
+// capture groups, group n at index n - 1
+static struct capture_group capture_groups[IRQTS_GROUPS];
+
+/* Returns the current time of a capture clock. Safe in hard irq context. */
+static inline ktime_t clock_now(enum irqts_clock clock)
+{
+    switch (clock)
+    {
+    case IRQTS_CLOCK_MONOTONIC_RAW:
+        return ktime_get_raw();
+    case IRQTS_CLOCK_BOOTTIME:
+        return ktime_get_boottime();
+    case IRQTS_CLOCK_TAI:
+        return ktime_get_clocktai();
+    default:
+        return ktime_get();
+    }
+}
+
+#if defined(IRQTS_LATENCY_STATS) || defined(IRQTS_BENCH)
+// /sys/kernel/debug/{CLASS_NAME}/, holds the built in instrumentation
+static struct dentry* debugfs_dir;
+#endif
+
+#ifdef IRQTS_LATENCY_STATS
+/*
+ * Latency instrumentation, built with "make LATENCY_STATS=y". Keeps per-cpu
+ * log2 histograms of the cost of gpio_irq_handler and of the delay from
+ * timestamping an edge to capturing it in the irq thread, readable in
+ * /sys/kernel/debug/{CLASS_NAME}/.
+ */
+#define LATENCY_BUCKETS 32  // bucket i >= 1 holds [2^(i-1), 2^i) ns
+
+/* struct representing a log2 histogram of latencies in nanoseconds */
+struct latency_hist {
+    unsigned long buckets[LATENCY_BUCKETS];
+};
+
+static DEFINE_PER_CPU(struct latency_hist, handler_hist);
+static DEFINE_PER_CPU(struct latency_hist, thread_hist);
+
+/*
+ * Adds the time elapsed since start on clock to the histogram of the current
+ * cpu.
+ */
+static inline void latency_record(struct latency_hist __percpu* hist,
+        ktime_t start, enum irqts_clock clock)
+{
+    s64 delta = ktime_to_ns(ktime_sub(clock_now(clock), start));
+    unsigned int bucket = 0;
+
+    if (delta > 0)
+    {
+        bucket = min_t(unsigned int, ilog2((u64) delta) + 1,
+                LATENCY_BUCKETS - 1);
+    }
+    this_cpu_inc(hist->buckets[bucket]);
+}
+
+static inline void record_handler_latency(ktime_t start,
+        enum irqts_clock clock)
+{
+    latency_record(&handler_hist, start, clock);
+}
+
+static inline void record_thread_latency(ktime_t stamp,
+        enum irqts_clock clock)
+{
+    latency_record(&thread_hist, stamp, clock);
+}
+
+/**
+ * Invoked when read from /sys/kernel/debug/{CLASS_NAME}/{HISTOGRAM}
+ */
+static int latency_hist_show(struct seq_file* s, void* unused)
+{
+    struct latency_hist __percpu* hist = s->private;
+    unsigned int cpu;
+    unsigned int i;
+
+    // one row per bucket, starting with its lower bound, one column per cpu
+    seq_puts(s, "ns");
+    for_each_possible_cpu(cpu)
+    {
+        seq_printf(s, " cpu%u", cpu);
+    }
+    seq_putc(s, '\n');
+    for (i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        seq_printf(s, "%llu", i == 0 ? 0ULL : 1ULL << (i - 1));
+        for_each_possible_cpu(cpu)
+        {
+            seq_printf(s, " %lu", per_cpu_ptr(hist, cpu)->buckets[i]);
+        }
+        seq_putc(s, '\n');
+    }
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(latency_hist);
+
+static void latency_stats_init(void)
+{
+    debugfs_create_file("handler_latency", 0444, debugfs_dir,
+            (void*) &handler_hist, &latency_hist_fops);
+    debugfs_create_file("thread_latency", 0444, debugfs_dir,
+            (void*) &thread_hist, &latency_hist_fops);
+}
+#else
+static inline void record_handler_latency(ktime_t start,
+        enum irqts_clock clock) { }
+static inline void record_thread_latency(ktime_t stamp,
+        enum irqts_clock clock) { }
+static inline void latency_stats_init(void) { }
+#endif
+
+/* sources of edge timestamps, software ones first */
+enum gpio_timestamp {
+    GPIO_TIMESTAMP_SOFTWARE,    // capture clock read in the irq handler
+    GPIO_TIMESTAMP_HTE,         // hardware timestamping engine
+    GPIO_TIMESTAMP_AUTO,        // hardware if supported, else software
+};
+
+struct gpio_data;
+
+/*
+ * struct representing a source of edge timestamps. start and stop begin
+ * and end staging the gpio's edges, with stop waiting for running handlers.
+ * pause and resume are optional and hold off capture while the ring is
+ * replaced. kick is optional and runs the drain of the staging slots from
+ * timer context; sources without it cannot filter glitches in software.
+ * set_affinity is optional and moves the handlers of the gpio to a cpu, or
+ * lets them run anywhere for cpu -1. now is optional and returns the current
+ * time on the clock of the timestamps.
+ */
+struct timestamp_source {
+    const char* name;
+    int (*start)(struct gpio_data* gpioData);
+    void (*stop)(struct gpio_data* gpioData);
+    void (*pause)(struct gpio_data* gpioData);
+    void (*resume)(struct gpio_data* gpioData);
+    void (*kick)(struct gpio_data* gpioData);
+    int (*set_affinity)(struct gpio_data* gpioData, int cpu);
+    ktime_t (*now)(struct gpio_data* gpioData);
+};
+
+/* in-kernel pulse decoders, timings of each in pulse_protocols */
+enum gpio_decoder {
+    GPIO_DECODER_NONE,
+    GPIO_DECODER_NEC,
+    GPIO_DECODER_RC5,
+    GPIO_DECODER_MANCHESTER,
+};
+
+/* encodings of the timings read from the gpio device */
+enum gpio_encoding {
+    GPIO_ENCODING_RAW,      // ring entries as they are
+    GPIO_ENCODING_PACKED,   // struct irqts_packed_header and varints
+};
+
+/* policies for edges arriving while the ring is full */
+enum gpio_overflow {
+    GPIO_OVERFLOW_OVERWRITE,    // overwrite the oldest unread timings
+    GPIO_OVERFLOW_DROP,         // drop the new edges
+    GPIO_OVERFLOW_STOP,         // stop capture until the ring is read empty
+};
+
+/* struct representing a frame decoded from the pulses of a gpio */
+struct decoded_frame {
+    u64 timestamp;  // ns of the first edge of the frame
+    u64 data;
+    u32 bits;       // 0 for a repeat frame
+};
+
+/* struct representing the state of the pulse decoder of a gpio */
+struct pulse_decoder {
+    ktime_t lastEdge;
+    ktime_t frameStart;
+    u64 data;
+    u32 count;      // bits, or half bits for biphase coding
+    u8 state;
+    bool firstHalf; // level of the first half of the current bit
+};
+
+/* states of the triggered capture of a gpio */
+enum {
+    TRIGGER_ARMED,      // waiting for a pulse matching the trigger
+    TRIGGER_COLLECTING, // collecting the edges after the trigger
+    TRIGGER_FROZEN,     // snapshot complete, waiting to be re-armed
+};
+
+/* struct representing the edges around a trigger, see struct irqts_snapshot */
+struct trigger_snapshot {
+    struct irqts_snapshot header;
+    u64 entries[];  // IRQTS_FORMAT_NS entries or IRQTS_DROP64
+};
+
+/*
+ * struct representing the streaming pulse statistics of a gpio. The mean
+ * and the sum of squared deviations m2 follow Welford's method, with the
+ * mean in fixed point and m2 in 128 bits so deviations of the longest
+ * widths fit.
+ */
+struct pulse_stats {
+    struct irqts_pulse_stats record;    // all but mean, variance and duty
+    s64 mean;       // ns << PULSE_MEAN_SHIFT
+    u64 m2[2];      // ns^2, low word first
+};
+
+/* struct representing the configurable capture settings of a gpio */
+struct gpio_config {
+    enum gpio_timestamp timestamp;  // fixed once registered
+    enum irqts_edge edge;           // fixed once registered
+    enum irqts_clock clock;         // fixed once registered
+    enum irqts_format format;
+    u32 capacity;   // timings in ring, power of two
+    u32 batchSize;  // timings per sysfs read, and read buffer size
+    u32 watermark;  // unread timings that wake up readers
+    enum gpio_decoder decoder;
+    u32 decodeUnit; // ns, 0 for the protocol's default
+    u32 decodeBits; // 0 for the protocol's default
+    u32 minPulse;   // ns, shorter pulses are filtered as glitches
+    u32 idleTimeout;    // ns without edges that end a frame, 0 for off
+    enum gpio_encoding encoding;
+    int cpu;        // cpu running the handlers, -1 for any
+    u32 priority;   // SCHED_FIFO priority of the irq thread, 0 for default
+    enum gpio_overflow overflow;
+    u32 triggerMin; // ns, shortest pulse that triggers, 0 for off
+    u32 triggerMax; // ns, longest pulse that triggers, 0 for no limit
+    u32 preTrigger; // edges kept before the trigger
+    u32 postTrigger;    // edges kept after the trigger
+    u32 group;      // capture group, 0 for none, fixed once registered
+    u32 stormRate;  // edges per second that disable the irq, 0 for off
+    u32 samplePeriod;   // ns between samples while disabled, 0 for none
+    u32 pulseStats;     // 1 to aggregate pulse statistics, 0 for off
+};
+
+/*
+ * struct representing a single-producer/single-consumer ring of timings.
+ * The irq handler is the only producer and only advances head, readers are
+ * the only consumer and only advance tail. Both indices run freely and are
+ * masked on access, so head - tail is the number of unread timings. When the
+ * reader falls more than a full ring behind, the oldest timings are
+ * overwritten and skipped by the reader, unless the overflow policy of the
+ * gpio rejects new edges instead.
+ *
+ * The header and entries share one vmalloc_user() area which is mapped
+ * read-only into userspace, see struct irqts_ring_header. Entries are u32 or
+ * u64 depending on the capture format.
+ */
+struct timings_ring {
+    struct irqts_ring_header* header;
+    void* entries;
+    u32 mask;   // capacity - 1, capacity is a power of two
+    unsigned int entryShift;    // log2 of entry size
+};
+
+/* struct representing gpio data */
+struct gpio_data {
+    struct kref refcount;   // registry and open files hold a reference
+    unsigned int gpio;
+    struct gpio_desc* desc;
+    struct device* parent;  // platform device of the line, NULL for sysfs
+    struct capture_group* group;    // NULL if in no group
+    u8 groupMember; // member slot in group
+    u32 minor;
+    struct class_attribute class_attr_gpio;
+    struct cdev* cdev;
+    struct device* device;
+    unsigned int irq_number;
+    const struct timestamp_source* tsSource;
+    bool capturing;     // tsSource is started
+#if IS_ENABLED(CONFIG_HTE)
+    struct hte_ts_desc hteDesc;
+#endif
+    struct gpio_config config;  // written with configLock held, irq disabled
+    ktime_t lastInterruptTime;
+
+    // edges timestamped by the hard irq handler, waiting for the irq thread.
+    // stagingHead, stagingOverruns and stagingDropped are only written by the
+    // hard irq handler, stagingTail only by the irq thread. Each side's
+    // fields get their own cache line.
+    u64 staging[STAGING_SIZE];
+    u32 stagingHead ____cacheline_aligned_in_smp;
+    unsigned long stagingOverruns;
+    bool stagingDropped;    // mark the next staged edge with STAGING_DROP
+    u32 stagingTail ____cacheline_aligned_in_smp;
+    unsigned long stagingOverrunsSeen;  // irq thread only
+    u32 threadPriority; // applied config.priority, irq thread only
+
+    // timings ring, filled by irq thread. Under the drop and stop overflow
+    // policies, the drop marker of rejected edges is pushed once there is
+    // room for it.
+    struct timings_ring ring;
+    u32 ringGeneration; // ring_generation of the ring, set with the ring
+    bool ringDropPending;
+    bool captureStopped;
+    unsigned long edgesRejected;
+
+    // glitch filter. An edge is held back by the irq thread until the next
+    // edge or glitchTimer shows the pulse it starts is not a glitch.
+    bool hwDebounce;    // minPulse is applied by the gpio controller
+    bool glitchPending;
+    bool glitchLevel;
+    ktime_t glitchTime;
+    struct hrtimer glitchTimer;
+    unsigned long glitchesFiltered;
+
+    // interrupt storm guard. The hard irq handler counts edges per
+    // STORM_WINDOW and above stormRate disables the irq, handing over to
+    // stormTimer until STORM_HOLDOFF passed. stormTimer samples the line
+    // every samplePeriod ns meanwhile. storming is set by the hard irq
+    // handler and cleared by stormTimer, or with both stopped.
+    ktime_t stormWindow;    // start of the current window
+    u32 stormEdges;     // edges in the current window
+    bool storming;
+    bool sampledLevel;
+    ktime_t stormEnd;   // CLOCK_MONOTONIC, the clock of stormTimer
+    struct hrtimer stormTimer;
+    unsigned long storms;
+
+    // idle gap segmentation. idleTimer is restarted by the irq thread on
+    // edges, and on expiry ends the frame at the ring's head.
+    struct hrtimer idleTimer;
+    unsigned long idleFrames;
+
+    // pulse decoder, fed by the irq thread. frameHead is only written by the
+    // irq thread, frameTail by readers of the frames attribute.
+    struct pulse_decoder decoder;
+    struct decoded_frame frames[FRAME_FIFO_SIZE];
+    u32 frameHead;
+    u32 frameTail;
+    unsigned long framesDecoded;
+    unsigned long framesDropped;
+
+    // triggered capture. history keeps the last preTrigger edges and the
+    // snapshot is written by the irq thread until frozen. Readers of the
+    // snapshot and re-arming it hold snapshotLock.
+    u64* history;
+    u32 historyIndex;   // next slot of history to write
+    u32 historyCount;   // valid slots of history
+    ktime_t triggerEdge;    // previous edge, for the pulse width
+    bool triggerHasEdge;
+    struct trigger_snapshot* snapshot;
+    u8 triggerState;
+    struct mutex snapshotLock;
+    unsigned long triggersFired;
+
+    // pulse statistics, written by the irq thread in pulseSeq write sections.
+    // Readers of pulse_stats request a reset with pulseReset, which the irq
+    // thread carries out on the next edge.
+    struct pulse_stats pulseStats;
+    seqcount_t pulseSeq;
+    ktime_t pulseEdge;  // previous edge, for the width
+    bool pulseHasEdge;
+    bool pulseReset;
+
+#ifdef IRQTS_BENCH
+    // synthetic edges staged by injectTimer in place of the paused timestamp
+    // source, see inject_timer_expired
+    struct hrtimer injectTimer;
+    bool injecting;     // set and cleared with configLock held
+    u8 injectPattern;
+    u32 injectPeriod;   // ns between injected edges
+    bool injectLevel;
+    ktime_t injectNext; // timestamp of the next injected edge
+    ktime_t injectStart;
+    ktime_t injectEnd;
+    unsigned long injected;
+    u64 injectCost;     // ns spent staging injected edges
+    unsigned long injectCaptured;   // edgesCaptured at start
+    unsigned long injectDropped;    // stagingOverruns at start
+    unsigned long injectOverwritten;    // edgesOverwritten at start
+    unsigned long injectRejected;   // edgesRejected at start
+#endif
+
+    // producer statistics, only written by the irq thread
+    unsigned long edgesCaptured;
+    unsigned long edgesOverwritten;
+    unsigned long readerWakeups;
+    u32 maxDepth;
+
+    // consumer side, readLock serializes readers of the ring
+    void* readBuf;  // config.batchSize entries
+    struct mutex readLock;
+    unsigned long readerGaps;   // drop markers returned to readers
+    u8 packBuf[PACK_BUF_SIZE];  // varints of packed reads
+    bool packGap;   // packed read ended with a drop marker
+
+    // configLock serializes changes to config with opening the gpio device
+    struct mutex configLock;
+    unsigned int openCount;
+
+    // writeback of the timings to a file. wbWork is queued by the irq thread
+    // and consumes the ring like a reader, writing whole WRITEBACK_SIZE
+    // buffers. wbLock serializes it with starting and stopping writeback.
+    struct work_struct wbWork;
+    struct mutex wbLock;
+    struct file* wbFile;    // NULL if writeback is off
+    char* wbPath;
+    void* wbBuf;
+    size_t wbUsed;  // bytes of timings in wbBuf
+    loff_t wbPos;
+    unsigned long wbErrors;
+
+    // readers sleeping until watermark timings are unread. Readers arm the
+    // wakeup with the head to wake at, the irq handler disarms it on wakeup.
+    wait_queue_head_t readWait;
+    u32 wakeupHead;
+    bool wakeupArmed;
+    bool removed;   // set once the gpio is unregistered
+};
+
+static inline u32 ring_capacity(const struct timings_ring* ring)
+{
+    return ring->mask + 1;
+}
+
+static inline size_t ring_entry_size(const struct timings_ring* ring)
+{
+    return (size_t) 1 << ring->entryShift;
+}
+
+/* Returns size in bytes of the ring entries of a capture format */
+static inline size_t format_entry_size(enum irqts_format format)
+{
+    return format == IRQTS_FORMAT_NS ? sizeof(u64) : sizeof(u32);
+}
+
+/*
+ * Allocates a ring of the capacity, capture format, edges and clock of
+ * config.
+ */
+static int ring_alloc(struct timings_ring* ring,
+        const struct gpio_config* config)
+{
+    size_t entrySize = format_entry_size(config->format);
+    u32 capacity = config->capacity;
+
+    ring->header = vmalloc_user(PAGE_SIZE + capacity * entrySize);
+    if (ring->header == NULL)
+    {
+        return -ENOMEM;
+    }
+    ring->entries = (char*) ring->header + PAGE_SIZE;
+    ring->mask = capacity - 1;
+    ring->entryShift = ilog2(entrySize);
+
+    ring->header->magic = IRQTS_RING_MAGIC;
+    ring->header->version = IRQTS_RING_VERSION;
+    ring->header->capacity = capacity;
+    ring->header->entry_size = entrySize;
+    ring->header->data_offset = PAGE_SIZE;
+    ring->header->format = config->format;
+    ring->header->edge = config->edge;
+    ring->header->clock = config->clock;
+    return 0;
+}
+
+static void ring_free(struct timings_ring* ring)
+{
+    vfree(ring->header);
+    ring->header = NULL;
+    ring->entries = NULL;
+}
+
+/*
+ * Appends an entry to a ring of u32 entries. Must only be called by the
+ * producer.
+ */
+static inline void ring_push32(struct timings_ring* ring, u32 entry)
+{
+    u32 head = ring->header->head;
+
+    ((u32*) ring->entries)[head & ring->mask] = entry;
+    // publish entry before the new head is visible to the reader
+    smp_store_release(&ring->header->head, head + 1);
+}
+
+/*
+ * Appends an entry to a ring of u64 entries. Must only be called by the
+ * producer. A torn entry is never seen by readers, since readers discard
+ * entries that may have been overwritten while they were copied.
+ */
+static inline void ring_push64(struct timings_ring* ring, u64 entry)
+{
+    u32 head = ring->header->head;
+
+    ((u64*) ring->entries)[head & ring->mask] = entry;
+    smp_store_release(&ring->header->head, head + 1);
+}
+
+/*
+ * Returns the number of unread timings. Must only be called by the consumer.
+ */
+static u32 ring_count(const struct timings_ring* ring)
+{
+    return min(smp_load_acquire(&ring->header->head) - ring->header->tail,
+            ring_capacity(ring));
+}
+
+/*
+ * Appends a drop marker to a ring. Must only be called by the producer.
+ */
+static inline void ring_push_drop(struct timings_ring* ring)
+{
+    if (ring->entryShift == ilog2(sizeof(u64)))
+    {
+        ring_push64(ring, IRQTS_DROP64);
+    }
+    else
+    {
+        ring_push32(ring, IRQTS_DROP32);
+    }
+}
+
+/*
+ * Appends a capture mode marker to a ring. Must only be called by the
+ * producer.
+ */
+static inline void ring_push_mode(struct timings_ring* ring, bool sampling)
+{
+    if (ring->entryShift == ilog2(sizeof(u64)))
+    {
+        ring_push64(ring, IRQTS_MODE64 | (sampling ? IRQTS_LEVEL64 : 0));
+    }
+    else
+    {
+        ring_push32(ring, IRQTS_MODE32 | (sampling ? IRQTS_LEVEL32 : 0));
+    }
+}
+
+/*
+ * Copies up to max of the oldest unread entries into dst and consumes them.
+ * Entries the producer overwrote before or during the copy are skipped and
+ * replaced by a single drop marker at the start of dst. Sets *dropped if so.
+ * Must only be called by the consumer.
+ */
+static size_t ring_read(struct timings_ring* ring, void* dst, size_t max,
+        bool* dropped)
+{
+    u32 capacity = ring_capacity(ring);
+    unsigned int shift = ring->entryShift;
+    u32 head, tail, count, first, lost, reserved;
+    char* out;
+
+    head = smp_load_acquire(&ring->header->head);
+    tail = ring->header->tail;
+    reserved = 0;
+    if (head - tail > capacity)
+    {
+        // keep room for the drop marker
+        tail = head - capacity;
+        reserved = 1;
+    }
+    out = (char*) dst + (reserved << shift);
+    count = min_t(u32, head - tail, max - reserved);
+    first = min(count, capacity - (tail & ring->mask));
+    memcpy(out, (char*) ring->entries + ((tail & ring->mask) << shift),
+            first << shift);
+    memcpy(out + (first << shift), ring->entries, (count - first) << shift);
+
+    // drop any entries the producer overwrote while they were being copied
+    smp_rmb();
+    head = READ_ONCE(ring->header->head);
+    lost = 0;
+    if (head - tail > capacity)
+    {
+        lost = min(head - tail - capacity, count);
+    }
+    smp_store_release(&ring->header->tail, tail + count);
+
+    *dropped = reserved > 0 || lost > 0;
+    if (!*dropped)
+    {
+        return count;
+    }
+    // the marker takes the first slot, of either the reserved or lost entries
+    memmove((char*) dst + (1 << shift), out + (lost << shift),
+            (count - lost) << shift);
+    if (shift == ilog2(sizeof(u64)))
+    {
+        *(u64*) dst = IRQTS_DROP64;
+    }
+    else
+    {
+        *(u32*) dst = IRQTS_DROP32;
+    }
+    return count - lost + 1;
+}
+
+/*
+ * Reads from the ring of a gpio into its read buffer, counting the gaps
+ * seen by readers. Must be called with readLock held.
+ */
+static size_t read_timings(struct gpio_data* gpioData, size_t max)
+{
+    bool dropped;
+    size_t count;
+
+    count = ring_read(&gpioData->ring, gpioData->readBuf, max, &dropped);
+    if (dropped)
+    {
+        gpioData->readerGaps++;
+    }
+    trace_irqts_consume(gpioData->gpio, count, gpioData->ring.header->tail);
+    return count;
+}
+
+/*
+ * Wakes up readers once the wakeup head is reached. Called by the producer
+ * after each batch of timings, this only costs a barrier and a load while no
+ * reader is waiting.
+ */
+static inline void wakeup_readers(struct gpio_data* gpioData)
+{
+    // order the store of head before the load of wakeupArmed, pairs with
+    // the barrier in gpio_readable
+    smp_mb();
+    if (READ_ONCE(gpioData->wakeupArmed)
+            && (s32) (gpioData->ring.header->head
+                      - READ_ONCE(gpioData->wakeupHead)) >= 0)
+    {
+        WRITE_ONCE(gpioData->wakeupArmed, false);
+        wake_up_interruptible(&gpioData->readWait);
+        gpioData->readerWakeups++;
+        trace_irqts_wakeup(gpioData->gpio, gpioData->ring.header->head,
+                READ_ONCE(gpioData->ring.header->tail));
+    }
+}
+
+/*
+ * Returns the number of unread timings before the last idle gap, 0 if idle
+ * gap segmentation is off. Must only be called by the consumer.
+ */
+static u32 closed_frame_count(struct gpio_data* gpioData)
+{
+    struct irqts_ring_header* header = gpioData->ring.header;
+    s32 count;
+
+    if (READ_ONCE(gpioData->config.idleTimeout) == 0)
+    {
+        return 0;
+    }
+    count = smp_load_acquire(&header->frame_end) - header->tail;
+    return count > 0 ? min_t(u32, count, ring_capacity(&gpioData->ring)) : 0;
+}
+
+/*
+ * Returns true if at least watermark timings or a frame ended by an idle gap
+ * are unread, otherwise arms the wakeup for when watermark timings are. Used
+ * as wait condition by readers and poll.
+ */
+static bool gpio_readable(struct gpio_data* gpioData)
+{
+    u32 watermark = READ_ONCE(gpioData->config.watermark);
+
+    WRITE_ONCE(gpioData->wakeupHead,
+            READ_ONCE(gpioData->ring.header->tail) + watermark);
+    // publishes wakeupHead before the wakeup is armed
+    smp_store_release(&gpioData->wakeupArmed, true);
+    // order arming before the load of head, pairs with the barrier in
+    // wakeup_readers so either side sees the other
+    smp_mb();
+    return ring_count(&gpioData->ring) >= watermark
+            || closed_frame_count(gpioData) > 0
+            || READ_ONCE(gpioData->removed);
+}
+
+/*
+ * Invoked when the last reference to a gpio_data is dropped.
+ */
+static void release_gpio_data(struct kref* kref)
+{
+    struct gpio_data* gpioData = container_of(kref, struct gpio_data,
+            refcount);
+
+    ring_free(&gpioData->ring);
+    kfree(gpioData->readBuf);
+    kfree(gpioData->history);
+    kfree(gpioData->snapshot);
+    kfree(gpioData->class_attr_gpio.attr.name);
+    kmem_cache_free(gpio_data_cache, gpioData);
+}
+
+/*
+ * Removes gpio data from the registry and drops the registry's reference
+ * once lockless lookups can no longer find it. Must be called with
+ * registry_lock held.
+ */
+static void free_gpio_data(struct gpio_data* gpioData)
+{
+    xa_cmpxchg(&registered_gpios, gpioData->gpio, gpioData, NULL, 0);
+    xa_cmpxchg(&gpio_minors, gpioData->minor, gpioData, NULL, 0);
+    synchronize_rcu();
+    kref_put(&gpioData->refcount, release_gpio_data);
+}
+
+/*
+ * Returns the u32 entry for a time since the previous edge, saturated to
+ * IRQTS_OVERFLOW32 if it does not fit. Negative times, from a capture clock
+ * set back, read as 0.
+ */
+static inline u32 delta_entry(s64 delta)
+{
+    if (delta < 0)
+    {
+        return 0;
+    }
+    // timings at or above IRQTS_MODE32 would read as markers
+    return delta < IRQTS_MODE32 ? (u32) delta : IRQTS_OVERFLOW32;
+}
+
+/*
+ * Updates the producer statistics for an entry about to be pushed to the
+ * ring of a gpio. Must only be called by the irq thread.
+ */
+static inline void account_push(struct gpio_data* gpio_data)
+{
+    struct irqts_ring_header* header = gpio_data->ring.header;
+    u32 depth = header->head - READ_ONCE(header->tail);
+
+    if (depth >= ring_capacity(&gpio_data->ring))
+    {
+        gpio_data->edgesOverwritten++;
+        trace_irqts_drop(gpio_data->gpio, 1, IRQTS_DROP_OVERWRITTEN);
+    }
+    else if (depth + 1 > gpio_data->maxDepth)
+    {
+        gpio_data->maxDepth = depth + 1;
+    }
+}
+
+/*
+ * Returns true if an edge may be pushed to the ring of a gpio under its
+ * overflow policy, after pushing a pending drop marker. Rejected edges are
+ * counted as lost before reaching the ring. Must only be called by the irq
+ * thread.
+ */
+static bool ring_admit(struct gpio_data* gpio_data)
+{
+    struct timings_ring* ring = &gpio_data->ring;
+    u32 used = 0;
+
+    if (gpio_data->config.overflow != GPIO_OVERFLOW_OVERWRITE)
+    {
+        // pairs with the release of tail by the reader
+        used = ring->header->head - smp_load_acquire(&ring->header->tail);
+        if (gpio_data->captureStopped && used > 0)
+        {
+            goto Rejected;
+        }
+        gpio_data->captureStopped = false;
+        // keep a slot for the drop marker in front of the edge
+        if (used + (gpio_data->ringDropPending ? 2 : 1) > ring_capacity(ring))
+        {
+            gpio_data->captureStopped =
+                    gpio_data->config.overflow == GPIO_OVERFLOW_STOP;
+            goto Rejected;
+        }
+    }
+    if (gpio_data->ringDropPending)
+    {
+        account_push(gpio_data);
+        ring_push_drop(ring);
+        gpio_data->ringDropPending = false;
+    }
+    return true;
+
+Rejected:
+    gpio_data->ringDropPending = true;
+    gpio_data->edgesRejected++;
+    trace_irqts_drop(gpio_data->gpio, 1, IRQTS_DROP_REJECTED);
+    WRITE_ONCE(ring->header->dropped, ring->header->dropped + 1);
+    return false;
+}
+
+/*
+ * Stages a timestamp with its STAGING_* flags, or drops it when the staging
+ * slots are full.
+ */
+static inline void stage_stamp(struct gpio_data* gpio_data, u64 stamp)
+{
+    u32 head = gpio_data->stagingHead;
+
+    if (head - smp_load_acquire(&gpio_data->stagingTail) >= STAGING_SIZE)
+    {
+        gpio_data->stagingOverruns++;
+        gpio_data->stagingDropped = true;
+        return;
+    }
+    gpio_data->staging[head & (STAGING_SIZE - 1)] = stamp
+            | (gpio_data->stagingDropped ? STAGING_DROP : 0);
+    gpio_data->stagingDropped = false;
+    smp_store_release(&gpio_data->stagingHead, head + 1);
+}
+
+/*
+ * Appends an edge of a gpio to the ring of its capture group, with the
+ * levels of all members after it.
+ */
+static inline void group_push(struct gpio_data* gpio_data, ktime_t timeNow,
+        bool level)
+{
+    struct capture_group* group = gpio_data->group;
+    struct irqts_group_event* event;
+    u16 bit = BIT(gpio_data->groupMember);
+    unsigned long flags;
+
+    raw_spin_lock_irqsave(&group->lock, flags);
+    // edges of different pins may be timestamped on other cpus out of order
+    group->lastTime = max_t(u64, group->lastTime, ktime_to_ns(timeNow));
+    group->levels = level ? group->levels | bit : group->levels & ~bit;
+    event = &group->events[group->head & (GROUP_RING_SIZE - 1)];
+    event->timestamp = group->lastTime;
+    event->gpio = gpio_data->gpio;
+    event->levels = group->levels;
+    event->member = gpio_data->groupMember;
+    event->flags = 0;
+    WRITE_ONCE(group->head, group->head + 1);
+    raw_spin_unlock_irqrestore(&group->lock, flags);
+}
+
+/*
+ * Stages an edge for the irq thread, and adds it to the capture group of the
+ * gpio. Edges are dropped when the staging slots are full. Must only be
+ * called from the hard irq handler of the timestamp source.
+ */
+static inline void stage_edge(struct gpio_data* gpio_data, ktime_t timeNow,
+        bool level)
+{
+    if (gpio_data->group != NULL)
+    {
+        group_push(gpio_data, timeNow, level);
+    }
+    stage_stamp(gpio_data, ktime_to_ns(timeNow)
+            | (level ? STAGING_LEVEL : 0));
+}
+
+/*
+ * Stages a capture mode change of the storm guard for the irq thread. Must
+ * only be called from the hard irq handler or stormTimer.
+ */
+static inline void stage_mode(struct gpio_data* gpio_data, ktime_t timeNow,
+        bool sampling)
+{
+    stage_stamp(gpio_data, ktime_to_ns(timeNow) | STAGING_MODE
+            | (sampling ? STAGING_LEVEL : 0));
+}
+
+/*
+ * Returns the level of a gpio after an edge. Only read from the line when
+ * both edges are captured, otherwise given by the captured edge.
+ */
+static inline bool edge_level(struct gpio_data* gpio_data)
+{
+    switch (gpio_data->config.edge)
+    {
+    case IRQTS_EDGE_RISING:
+        return true;
+    case IRQTS_EDGE_FALLING:
+        return false;
+    default:
+        return gpiod_get_value(gpio_data->desc) > 0;
+    }
+}
+
+/*
+ * Returns the physical edge of the line captured for the configured edge of
+ * a gpio, which is the logical one. They differ on active-low lines.
+ */
+static enum irqts_edge line_edge(struct gpio_data* gpioData)
+{
+    if (gpioData->config.edge == IRQTS_EDGE_BOTH
+            || !gpiod_is_active_low(gpioData->desc))
+    {
+        return gpioData->config.edge;
+    }
+    return gpioData->config.edge == IRQTS_EDGE_RISING
+            ? IRQTS_EDGE_FALLING : IRQTS_EDGE_RISING;
+}
+
+/*
+ * Counts an edge against the storm guard of a gpio, and above its storm rate
+ * disables the irq and starts stormTimer. Must only be called from the hard
+ * irq handler.
+ */
+static inline void storm_check(struct gpio_data* gpio_data, ktime_t timeNow)
+{
+    u32 rate = READ_ONCE(gpio_data->config.stormRate);
+    u32 period = READ_ONCE(gpio_data->config.samplePeriod);
+    ktime_t monoNow;
+
+    if (rate == 0 || gpio_data->storming)
+    {
+        return;
+    }
+    if (ktime_to_ns(ktime_sub(timeNow, gpio_data->stormWindow))
+            >= STORM_WINDOW)
+    {
+        gpio_data->stormWindow = timeNow;
+        gpio_data->stormEdges = 0;
+    }
+    if (++gpio_data->stormEdges <= rate / MIN_STORM_RATE)
+    {
+        return;
+    }
+
+    disable_irq_nosync(gpio_data->irq_number);
+    gpio_data->storming = true;
+    gpio_data->storms++;
+    stage_mode(gpio_data, timeNow, period > 0);
+    gpio_data->sampledLevel = gpiod_get_value(gpio_data->desc) > 0;
+    // the holdoff runs on the clock of stormTimer, whatever the capture clock
+    monoNow = ktime_get();
+    gpio_data->stormEnd = ktime_add_ns(monoNow, STORM_HOLDOFF);
+    hrtimer_start(&gpio_data->stormTimer, period > 0
+            ? ktime_add_ns(monoNow, period) : gpio_data->stormEnd,
+            HRTIMER_MODE_ABS_HARD);
+}
+
+/*
+ * Runs while the irq of a gpio is disabled by the storm guard. Stages the
+ * sampled level of the line when it changed, and enables the irq again once
+ * the holdoff passed.
+ */
+static enum hrtimer_restart storm_timer_expired(struct hrtimer* timer)
+{
+    struct gpio_data* gpio_data = container_of(timer, struct gpio_data,
+            stormTimer);
+    u32 period = READ_ONCE(gpio_data->config.samplePeriod);
+    ktime_t timeNow = clock_now(gpio_data->config.clock);
+    bool level;
+
+    if (ktime_compare(ktime_get(), gpio_data->stormEnd) >= 0)
+    {
+        stage_mode(gpio_data, timeNow, false);
+        gpio_data->stormWindow = timeNow;
+        gpio_data->stormEdges = 0;
+        gpio_data->storming = false;
+        enable_irq(gpio_data->irq_number);
+        irq_wake_thread(gpio_data->irq_number, gpio_data);
+        return HRTIMER_NORESTART;
+    }
+
+    // sampling turned off meanwhile, wait for the end of the holdoff
+    if (period == 0)
+    {
+        hrtimer_set_expires(timer, gpio_data->stormEnd);
+        return HRTIMER_RESTART;
+    }
+
+    level = gpiod_get_value(gpio_data->desc) > 0;
+    if (level != gpio_data->sampledLevel)
+    {
+        gpio_data->sampledLevel = level;
+        stage_edge(gpio_data, timeNow, level);
+        irq_wake_thread(gpio_data->irq_number, gpio_data);
+    }
+    hrtimer_forward_now(timer, ns_to_ktime(period));
+    return HRTIMER_RESTART;
+}
+
+/*
+ * Ends a storm of a gpio with its irq and stormTimer stopped, enabling the
+ * irq the storm guard disabled.
+ */
+static void storm_stop(struct gpio_data* gpioData)
+{
+    hrtimer_cancel(&gpioData->stormTimer);
+    if (gpioData->storming)
+    {
+        stage_mode(gpioData, clock_now(gpioData->config.clock), false);
+        gpioData->storming = false;
+        enable_irq(gpioData->irq_number);
+    }
+}
+
+/*
+ * Hard irq handler. Only timestamps the edge into the staging slots, all
+ * other work is left to gpio_irq_thread to keep interrupts disabled as
+ * briefly as possible.
+ */
+static irqreturn_t gpio_irq_handler(int irq, void* data)
+{
+    struct gpio_data* gpio_data = (struct gpio_data*) data;
+    ktime_t timeNow = clock_now(gpio_data->config.clock);
+
+    stage_edge(gpio_data, timeNow, edge_level(gpio_data));
+    storm_check(gpio_data, timeNow);
+    record_handler_latency(timeNow, gpio_data->config.clock);
+
+    return IRQ_WAKE_THREAD;
+}
+
+/*
+ * Converts a staged edge into a ring entry of the capture format.
+ */
+static inline void capture_edge(struct gpio_data* gpio_data, ktime_t timeNow,
+        bool level)
+{
+    switch (gpio_data->config.format)
+    {
+    case IRQTS_FORMAT_NS:
+        ring_push64(&gpio_data->ring, ktime_to_ns(timeNow)
+                | (level ? IRQTS_LEVEL64 : 0));
+        break;
+    case IRQTS_FORMAT_NS_DELTA:
+        ring_push32(&gpio_data->ring, delta_entry(ktime_to_ns(
+                        ktime_sub(timeNow, gpio_data->lastInterruptTime)))
+                | (level ? IRQTS_LEVEL32 : 0));
+        break;
+    default:
+        ring_push32(&gpio_data->ring, delta_entry(ktime_us_delta(timeNow,
+                        gpio_data->lastInterruptTime))
+                | (level ? IRQTS_LEVEL32 : 0));
+        break;
+    }
+    gpio_data->lastInterruptTime = timeNow;
+}
+
+/* pulse codings of the decoder protocols */
+enum pulse_coding {
+    PULSE_DISTANCE, // marks of one unit, the bit is in the length of spaces
+    PULSE_BIPHASE,  // two half bits of opposite level per bit, one unit each
+};
+
+/* decoder states */
+enum {
+    DECODE_IDLE,
+    DECODE_HEADER,  // distance coding, after the header mark
+    DECODE_REPEAT,  // distance coding, after a repeat header
+    DECODE_DATA,
+};
+
+/*
+ * struct representing the timings of a decoder protocol, with lengths in
+ * units. Marks are the low level of the line, as output by IR receivers.
+ */
+struct pulse_protocol {
+    const char* name;
+    enum pulse_coding coding;
+    u32 unit;           // default unit in ns
+    u32 bits;           // default number of data bits of a frame
+    u8 headerMark;      // distance coding lengths, 0 if unused
+    u8 headerSpace;
+    u8 repeatSpace;
+    u8 zeroSpace;
+    u8 oneSpace;
+    bool oneFirstHalf;  // biphase coding, level of first half of a 1 bit
+};
+
+/* decoder protocols, indexed by enum gpio_decoder */
+static const struct pulse_protocol pulse_protocols[] = {
+    [GPIO_DECODER_NEC] = {
+        .name           = "nec",
+        .coding         = PULSE_DISTANCE,
+        .unit           = 562500,
+        .bits           = 32,   // lsb first
+        .headerMark     = 16,
+        .headerSpace    = 8,
+        .repeatSpace    = 4,
+        .zeroSpace      = 1,
+        .oneSpace       = 3,
+    },
+    [GPIO_DECODER_RC5] = {
+        .name           = "rc5",
+        .coding         = PULSE_BIPHASE,
+        .unit           = 889000,
+        .bits           = 14,   // msb first, from the start bits
+        .oneFirstHalf   = true, // space then mark
+    },
+    [GPIO_DECODER_MANCHESTER] = {
+        .name           = "manchester",
+        .coding         = PULSE_BIPHASE,
+        .unit           = 500000,
+        .bits           = 32,   // msb first
+        .oneFirstHalf   = false,    // low then high, as in IEEE 802.3
+    },
+};
+
+/*
+ * Returns whether a pulse lasted units of unit ns, within 25%.
+ */
+static inline bool pulse_matches(u64 duration, u32 unit, unsigned int units)
+{
+    u64 expected = (u64) unit * units;
+    u64 error = duration > expected ? duration - expected
+            : expected - duration;
+
+    return units > 0 && error * 4 <= expected;
+}
+
+/*
+ * Queues the decoded frame for readers of the frames attribute. Frames are
+ * dropped when the queue is full.
+ */
+static void emit_frame(struct gpio_data* gpio_data, u32 bits)
+{
+    struct pulse_decoder* decoder = &gpio_data->decoder;
+    u32 head = gpio_data->frameHead;
+
+    decoder->state = DECODE_IDLE;
+    if (head - smp_load_acquire(&gpio_data->frameTail) >= FRAME_FIFO_SIZE)
+    {
+        gpio_data->framesDropped++;
+        return;
+    }
+    gpio_data->frames[head & (FRAME_FIFO_SIZE - 1)] = (struct decoded_frame) {
+        .timestamp  = ktime_to_ns(decoder->frameStart),
+        .data       = bits > 0 ? decoder->data : 0,
+        .bits       = bits,
+    };
+    smp_store_release(&gpio_data->frameHead, head + 1);
+    gpio_data->framesDecoded++;
+}
+
+/*
+ * Decodes a pulse of a pulse distance protocol like NEC.
+ */
+static void decode_distance(struct gpio_data* gpio_data,
+        const struct pulse_protocol* protocol, u32 unit, u32 bits,
+        u64 duration, bool mark, ktime_t timeNow)
+{
+    struct pulse_decoder* decoder = &gpio_data->decoder;
+
+    // a header mark starts a frame in any state
+    if (mark && pulse_matches(duration, unit, protocol->headerMark))
+    {
+        decoder->state = DECODE_HEADER;
+        decoder->frameStart = ktime_sub_ns(timeNow, duration);
+        return;
+    }
+
+    switch (decoder->state)
+    {
+    case DECODE_HEADER:
+        if (!mark && pulse_matches(duration, unit, protocol->headerSpace))
+        {
+            decoder->state = DECODE_DATA;
+            decoder->data = 0;
+            decoder->count = 0;
+        }
+        else if (!mark && pulse_matches(duration, unit, protocol->repeatSpace))
+        {
+            decoder->state = DECODE_REPEAT;
+        }
+        else
+        {
+            decoder->state = DECODE_IDLE;
+        }
+        break;
+    case DECODE_REPEAT:
+        if (mark && pulse_matches(duration, unit, 1))
+        {
+            emit_frame(gpio_data, 0);
+        }
+        decoder->state = DECODE_IDLE;
+        break;
+    case DECODE_DATA:
+        if (mark)
+        {
+            // marks separate the bits, the one after the last bit ends it
+            if (!pulse_matches(duration, unit, 1))
+            {
+                decoder->state = DECODE_IDLE;
+            }
+            else if (decoder->count == bits)
+            {
+                emit_frame(gpio_data, bits);
+            }
+        }
+        else if (decoder->count < bits
+                && pulse_matches(duration, unit, protocol->zeroSpace))
+        {
+            decoder->count++;
+        }
+        else if (decoder->count < bits
+                && pulse_matches(duration, unit, protocol->oneSpace))
+        {
+            decoder->data |= BIT_ULL(decoder->count);
+            decoder->count++;
+        }
+        else
+        {
+            decoder->state = DECODE_IDLE;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * Adds a half bit to the frame of a biphase protocol.
+ */
+static void push_half_bit(struct gpio_data* gpio_data,
+        const struct pulse_protocol* protocol, u32 bits, bool level)
+{
+    struct pulse_decoder* decoder = &gpio_data->decoder;
+
+    if (decoder->count & 1)
+    {
+        // both halves of a bit are of opposite level
+        if (level == decoder->firstHalf)
+        {
+            decoder->state = DECODE_IDLE;
+            return;
+        }
+        decoder->data = (decoder->data << 1)
+                | (decoder->firstHalf == protocol->oneFirstHalf);
+    }
+    else
+    {
+        decoder->firstHalf = level;
+    }
+    if (++decoder->count == 2 * bits)
+    {
+        emit_frame(gpio_data, bits);
+    }
+}
+
+/*
+ * Decodes a pulse of a biphase protocol like RC5. A pulse longer than a bit
+ * is taken as the idle level before a frame, whose first bit starts with
+ * the idle level.
+ */
+static void decode_biphase(struct gpio_data* gpio_data,
+        const struct pulse_protocol* protocol, u32 unit, u32 bits,
+        u64 duration, bool level, ktime_t timeNow)
+{
+    struct pulse_decoder* decoder = &gpio_data->decoder;
+    u64 halves = div_u64(duration + unit / 2, unit);
+
+    if (halves > 2)
+    {
+        decoder->state = DECODE_DATA;
+        decoder->data = 0;
+        decoder->count = 0;
+        decoder->frameStart = timeNow;
+        push_half_bit(gpio_data, protocol, bits, level);
+        return;
+    }
+    if (decoder->state != DECODE_DATA || halves == 0)
+    {
+        decoder->state = DECODE_IDLE;
+        return;
+    }
+    push_half_bit(gpio_data, protocol, bits, level);
+    if (halves == 2 && decoder->state == DECODE_DATA)
+    {
+        push_half_bit(gpio_data, protocol, bits, level);
+    }
+
+    // the new level lasts at least until the end of the last half bit
+    if (decoder->state == DECODE_DATA && decoder->count == 2 * bits - 1)
+    {
+        push_half_bit(gpio_data, protocol, bits, !level);
+    }
+}
+
+/*
+ * Feeds the pulse ended by an edge to the decoder of a gpio. Must only be
+ * called by the irq thread.
+ */
+static void decode_edge(struct gpio_data* gpio_data, ktime_t timeNow,
+        bool level)
+{
+    const struct pulse_protocol* protocol =
+            &pulse_protocols[gpio_data->config.decoder];
+    struct gpio_config* config = &gpio_data->config;
+    u32 unit = config->decodeUnit > 0 ? config->decodeUnit : protocol->unit;
+    u32 bits = config->decodeBits > 0 ? config->decodeBits : protocol->bits;
+    u64 duration = ktime_to_ns(ktime_sub(timeNow,
+                gpio_data->decoder.lastEdge));
+
+    // the pulse that ended has the level before the edge
+    gpio_data->decoder.lastEdge = timeNow;
+    if (protocol->coding == PULSE_DISTANCE)
+    {
+        decode_distance(gpio_data, protocol, unit, bits, duration, level,
+                timeNow);
+    }
+    else
+    {
+        decode_biphase(gpio_data, protocol, unit, bits, duration, !level,
+                timeNow);
+    }
+}
+
+/*
+ * Adds an entry to the pre-trigger history of a gpio and, while collecting,
+ * to its snapshot, freezing the snapshot once complete. Must only be called
+ * by the irq thread.
+ */
+static void trigger_record(struct gpio_data* gpio_data, u64 entry)
+{
+    struct trigger_snapshot* snapshot = gpio_data->snapshot;
+    u32 pre = gpio_data->config.preTrigger;
+
+    if (gpio_data->triggerState == TRIGGER_COLLECTING)
+    {
+        snapshot->entries[snapshot->header.count++] = entry;
+        // the entry after the pre-trigger history is the trigger edge
+        snapshot->header.post = snapshot->header.count - snapshot->header.pre
+                - 1;
+        if (snapshot->header.post == gpio_data->config.postTrigger)
+        {
+            // pairs with the acquire of readers of the snapshot
+            smp_store_release(&gpio_data->triggerState, TRIGGER_FROZEN);
+            gpio_data->triggersFired++;
+        }
+    }
+    if (pre > 0)
+    {
+        gpio_data->history[gpio_data->historyIndex] = entry;
+        gpio_data->historyIndex = gpio_data->historyIndex + 1 == pre ? 0
+                : gpio_data->historyIndex + 1;
+        gpio_data->historyCount = min(gpio_data->historyCount + 1, pre);
+    }
+}
+
+/*
+ * Starts a snapshot of a gpio if the pulse ended by an edge matches the
+ * trigger, and records the edge. Must only be called by the irq thread.
+ */
+static void trigger_edge(struct gpio_data* gpio_data, ktime_t timeStamp,
+        bool level)
+{
+    struct trigger_snapshot* snapshot = gpio_data->snapshot;
+    struct gpio_config* config = &gpio_data->config;
+    u64 width = ktime_to_ns(ktime_sub(timeStamp, gpio_data->triggerEdge));
+    u32 slot;
+    u32 i;
+
+    if (smp_load_acquire(&gpio_data->triggerState) == TRIGGER_ARMED
+            && gpio_data->triggerHasEdge && width >= config->triggerMin
+            && (config->triggerMax == 0 || width <= config->triggerMax))
+    {
+        // copy the history oldest first, the trigger edge follows it
+        slot = gpio_data->historyCount < config->preTrigger ? 0
+                : gpio_data->historyIndex;
+        for (i = 0; i < gpio_data->historyCount; i++)
+        {
+            snapshot->entries[i] = gpio_data->history[slot];
+            slot = slot + 1 == config->preTrigger ? 0 : slot + 1;
+        }
+        snapshot->header.trigger = ktime_to_ns(timeStamp);
+        snapshot->header.width = width;
+        snapshot->header.pre = gpio_data->historyCount;
+        snapshot->header.post = 0;
+        snapshot->header.count = gpio_data->historyCount;
+        WRITE_ONCE(gpio_data->triggerState, TRIGGER_COLLECTING);
+    }
+    trigger_record(gpio_data, ktime_to_ns(timeStamp)
+            | (level ? IRQTS_LEVEL64 : 0));
+    gpio_data->triggerEdge = timeStamp;
+    gpio_data->triggerHasEdge = true;
+}
+
+/*
+ * Adds the width of the pulse ended by an edge to the pulse statistics of a
+ * gpio. Must only be called by the irq thread.
+ */
+static void pulse_stats_edge(struct gpio_data* gpio_data, ktime_t timeStamp,
+        bool level)
+{
+    struct pulse_stats* stats = &gpio_data->pulseStats;
+    struct irqts_pulse_stats* record = &stats->record;
+    u64 width = min_t(u64, ktime_to_ns(ktime_sub(timeStamp,
+                    gpio_data->pulseEdge)), MAX_PULSE_WIDTH);
+    s64 x = (s64) (width << PULSE_MEAN_SHIFT);
+    s64 delta;
+    u64 deviation;
+    u64 deviation2;
+    u64 square;
+    bool reset = READ_ONCE(gpio_data->pulseReset);
+
+    preempt_disable();
+    write_seqcount_begin(&gpio_data->pulseSeq);
+    if (reset)
+    {
+        memset(stats, 0, sizeof(*stats));
+        WRITE_ONCE(gpio_data->pulseReset, false);
+    }
+    if (record->start == 0)
+    {
+        record->start = ktime_to_ns(timeStamp);
+    }
+    record->last = ktime_to_ns(timeStamp);
+    if (gpio_data->pulseHasEdge && !reset)
+    {
+        record->count++;
+        record->min = record->count == 1 ? width : min(record->min, width);
+        record->max = max(record->max, width);
+        record->histogram[width < 2 ? 0
+                : min(fls64(width) - 1, IRQTS_PULSE_BUCKETS - 1)]++;
+
+        // both deviations have the same sign, their product takes 92 bits
+        delta = x - stats->mean;
+        stats->mean += div64_s64(delta, record->count);
+        deviation = abs(delta) >> PULSE_MEAN_SHIFT;
+        deviation2 = abs(x - stats->mean) >> PULSE_MEAN_SHIFT;
+        square = deviation * deviation2;
+        stats->m2[0] += square;
+        stats->m2[1] += mul_u64_u64_shr(deviation, deviation2, 64)
+                + (stats->m2[0] < square);
+
+        // the pulse that ended has the level before the edge
+        if (gpio_data->config.edge == IRQTS_EDGE_BOTH)
+        {
+            if (level)
+            {
+                record->low += width;
+            }
+            else
+            {
+                record->high += width;
+            }
+        }
+    }
+    write_seqcount_end(&gpio_data->pulseSeq);
+    preempt_enable();
+
+    gpio_data->pulseEdge = timeStamp;
+    gpio_data->pulseHasEdge = true;
+}
+
+/*
+ * Writes an edge to the ring of a gpio and feeds it to its decoder. Must
+ * only be called by the irq thread.
+ */
+static void commit_edge(struct gpio_data* gpio_data, ktime_t timeStamp,
+        bool level)
+{
+    if (ring_admit(gpio_data))
+    {
+        account_push(gpio_data);
+        gpio_data->edgesCaptured++;
+        capture_edge(gpio_data, timeStamp, level);
+        trace_irqts_capture(gpio_data->gpio, ktime_to_ns(timeStamp), level,
+                gpio_data->ring.header->head);
+    }
+    if (gpio_data->config.pulseStats)
+    {
+        pulse_stats_edge(gpio_data, timeStamp, level);
+    }
+    if (gpio_data->config.decoder != GPIO_DECODER_NONE)
+    {
+        decode_edge(gpio_data, timeStamp, level);
+    }
+    if (gpio_data->config.triggerMin > 0)
+    {
+        trigger_edge(gpio_data, timeStamp, level);
+    }
+    // the latency of stamps on another clock than ours cannot be measured
+    if (gpio_data->tsSource->now != NULL)
+    {
+        record_thread_latency(timeStamp, gpio_data->config.clock);
+    }
+}
+
+/*
+ * Changes the scheduling of the current thread to the configured priority,
+ * where 0 restores the default priority of irq threads. Must only be called
+ * from the irq thread of the timestamp source.
+ */
+static void set_thread_priority(struct gpio_data* gpio_data)
+{
+    struct sched_attr attr = {
+        .size           = sizeof(attr),
+        .sched_policy   = SCHED_FIFO,
+        .sched_priority = READ_ONCE(gpio_data->config.priority),
+    };
+
+    if (attr.sched_priority == 0)
+    {
+        sched_set_fifo(current);
+    }
+    else if (sched_setattr_nocheck(current, &attr) < 0)
+    {
+        printk(KERN_WARNING "irq_timings: error setting priority of gpio%u thread\n",
+                gpio_data->gpio);
+    }
+    gpio_data->threadPriority = attr.sched_priority;
+}
+
+/*
+ * Moves the staged edges into the timings ring and wakes up readers. Must
+ * only be called from the irq thread of the timestamp source.
+ */
+static void drain_staging(struct gpio_data* gpio_data)
+{
+    u32 head = smp_load_acquire(&gpio_data->stagingHead);
+    unsigned long overruns = READ_ONCE(gpio_data->stagingOverruns);
+    u32 minPulse = gpio_data->hwDebounce ? 0 : gpio_data->config.minPulse;
+    ktime_t timeStamp;
+    ktime_t deadline;
+    ktime_t timeNow;
+    bool level;
+    u32 frameHead = gpio_data->frameHead;
+    unsigned long triggers = gpio_data->triggersFired;
+    u32 ringHead = gpio_data->ring.header->head;
+    u32 staged = head - gpio_data->stagingTail;
+    struct device* device;
+    u32 tail;
+    u64 stamp;
+
+    if (READ_ONCE(gpio_data->config.priority) != gpio_data->threadPriority)
+    {
+        set_thread_priority(gpio_data);
+    }
+    if (overruns != gpio_data->stagingOverrunsSeen)
+    {
+        printk_ratelimited(KERN_WARNING "irq_timings: gpio%u dropped %lu edges\n",
+                gpio_data->gpio, overruns - gpio_data->stagingOverrunsSeen);
+        trace_irqts_drop(gpio_data->gpio,
+                overruns - gpio_data->stagingOverrunsSeen, IRQTS_DROP_STAGING);
+        WRITE_ONCE(gpio_data->ring.header->dropped,
+                gpio_data->ring.header->dropped
+                + (u32) (overruns - gpio_data->stagingOverrunsSeen));
+        gpio_data->stagingOverrunsSeen = overruns;
+    }
+
+    for (tail = gpio_data->stagingTail; tail != head; tail++)
+    {
+        stamp = gpio_data->staging[tail & (STAGING_SIZE - 1)];
+        timeStamp = ns_to_ktime(stamp
+                & ~(STAGING_LEVEL | STAGING_DROP | STAGING_MODE));
+        level = (stamp & STAGING_LEVEL) != 0;
+        if (stamp & STAGING_DROP)
+        {
+            // mark the lost edges in the stream, after the held back edge
+            if (gpio_data->glitchPending)
+            {
+                gpio_data->glitchPending = false;
+                commit_edge(gpio_data, gpio_data->glitchTime,
+                        gpio_data->glitchLevel);
+            }
+            gpio_data->ringDropPending = true;
+            gpio_data->decoder.state = DECODE_IDLE;
+            gpio_data->pulseHasEdge = false;
+            if (gpio_data->config.triggerMin > 0)
+            {
+                trigger_record(gpio_data, IRQTS_DROP64);
+                gpio_data->triggerHasEdge = false;
+            }
+        }
+
+        // mark capture mode changes in the stream, after the held back edge
+        if (stamp & STAGING_MODE)
+        {
+            if (gpio_data->glitchPending)
+            {
+                gpio_data->glitchPending = false;
+                commit_edge(gpio_data, gpio_data->glitchTime,
+                        gpio_data->glitchLevel);
+            }
+            if (ring_admit(gpio_data))
+            {
+                account_push(gpio_data);
+                ring_push_mode(&gpio_data->ring, level);
+            }
+            gpio_data->decoder.state = DECODE_IDLE;
+            gpio_data->pulseHasEdge = false;
+            gpio_data->triggerHasEdge = false;
+            continue;
+        }
+
+        // drop both edges of a pulse shorter than minPulse, otherwise
+        // commit the held back edge and hold back this one
+        if (gpio_data->glitchPending)
+        {
+            gpio_data->glitchPending = false;
+            if (ktime_to_ns(ktime_sub(timeStamp, gpio_data->glitchTime))
+                    < minPulse)
+            {
+                gpio_data->glitchesFiltered++;
+                continue;
+            }
+            commit_edge(gpio_data, gpio_data->glitchTime,
+                    gpio_data->glitchLevel);
+        }
+        if (minPulse == 0)
+        {
+            commit_edge(gpio_data, timeStamp, level);
+            continue;
+        }
+        gpio_data->glitchPending = true;
+        gpio_data->glitchTime = timeStamp;
+        gpio_data->glitchLevel = level;
+    }
+    // release staging slots only after they were read
+    smp_store_release(&gpio_data->stagingTail, tail);
+
+    // commit the held back edge once no glitch can end it any more
+    if (gpio_data->glitchPending)
+    {
+        deadline = ktime_add_ns(gpio_data->glitchTime, minPulse);
+        timeNow = clock_now(gpio_data->config.clock);
+        if (ktime_compare(timeNow, deadline) >= 0)
+        {
+            gpio_data->glitchPending = false;
+            commit_edge(gpio_data, gpio_data->glitchTime,
+                    gpio_data->glitchLevel);
+        }
+        else
+        {
+            hrtimer_start(&gpio_data->glitchTimer,
+                    ktime_sub(deadline, timeNow), HRTIMER_MODE_REL);
+        }
+    }
+    if (staged > 0)
+    {
+        trace_irqts_drain(gpio_data->gpio, staged,
+                gpio_data->ring.header->head, gpio_data->ring.header->head
+                - READ_ONCE(gpio_data->ring.header->tail));
+    }
+    wakeup_readers(gpio_data);
+
+    // hand a batch of timings to the writeback worker
+    if (READ_ONCE(gpio_data->wbFile) != NULL
+            && ring_count(&gpio_data->ring) >= gpio_data->config.batchSize)
+    {
+        queue_work(system_unbound_wq, &gpio_data->wbWork);
+    }
+
+    // wake up readers of the capture group, the edges are in its ring
+    if (staged > 0 && gpio_data->group != NULL
+            && wq_has_sleeper(&gpio_data->group->wait))
+    {
+        wake_up_interruptible(&gpio_data->group->wait);
+    }
+
+    // wake up readers of the merged device
+    if (atomic_read(&merge_readers) > 0
+            && gpio_data->ring.header->head != ringHead)
+    {
+        atomic_inc(&merge_seq);
+        wake_up_interruptible(&merge_wait);
+    }
+
+    // restart the idle gap timeout whenever edges were captured
+    if (gpio_data->config.idleTimeout > 0
+            && gpio_data->ring.header->head != ringHead)
+    {
+        hrtimer_start(&gpio_data->idleTimer,
+                ns_to_ktime(gpio_data->config.idleTimeout), HRTIMER_MODE_REL);
+    }
+
+    // let pollers of the frames attribute know about new frames. The device
+    // is removed only after the timestamp source is stopped.
+    device = READ_ONCE(gpio_data->device);
+    if (gpio_data->frameHead != frameHead && !IS_ERR_OR_NULL(device))
+    {
+        sysfs_notify(&device->kobj, NULL, "frames");
+    }
+    if (gpio_data->triggersFired != triggers && !IS_ERR_OR_NULL(device))
+    {
+        sysfs_notify(&device->kobj, NULL, "snapshot");
+    }
+}
+
+/*
+ * Invoked when no edge arrived for idleTimeout ns. Ends the frame, so that
+ * readers get the timings before the idle gap without waiting for the
+ * watermark.
+ */
+static enum hrtimer_restart idle_timer_expired(struct hrtimer* timer)
+{
+    struct gpio_data* gpio_data = container_of(timer, struct gpio_data,
+            idleTimer);
+    struct irqts_ring_header* header = gpio_data->ring.header;
+
+    smp_store_release(&header->frame_end, smp_load_acquire(&header->head));
+    gpio_data->idleFrames++;
+    wake_up_interruptible(&gpio_data->readWait);
+
+    return HRTIMER_NORESTART;
+}
+
+/*
+ * Invoked when the edge held back by the glitch filter can be committed.
+ */
+static enum hrtimer_restart glitch_timer_expired(struct hrtimer* timer)
+{
+    struct gpio_data* gpio_data = container_of(timer, struct gpio_data,
+            glitchTimer);
+
+    gpio_data->tsSource->kick(gpio_data);
+
+    return HRTIMER_NORESTART;
+}
+
+/*
+ * Threaded irq handler. Runs again if edges are staged while it is running.
+ */
+static irqreturn_t gpio_irq_thread(int irq, void* data)
+{
+    drain_staging((struct gpio_data*) data);
+
+    return IRQ_HANDLED;
+}
+
+/*
+ * Software timestamps, read from the capture clock in the gpio's irq handler.
+ */
+static int software_ts_start(struct gpio_data* gpioData)
+{
+    static const unsigned long triggers[] = {
+        [IRQTS_EDGE_BOTH]       = IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING,
+        [IRQTS_EDGE_RISING]     = IRQF_TRIGGER_RISING,
+        [IRQTS_EDGE_FALLING]    = IRQF_TRIGGER_FALLING,
+    };
+    int irq = gpiod_to_irq(gpioData->desc);
+
+    if (irq < 0)
+    {
+        return irq;
+    }
+    gpioData->irq_number = irq;
+    return request_threaded_irq(gpioData->irq_number,
+            gpio_irq_handler, gpio_irq_thread,
+            triggers[line_edge(gpioData)],
+            gpioData->class_attr_gpio.attr.name, gpioData);
+}
+
+static void software_ts_stop(struct gpio_data* gpioData)
+{
+    // no storm may disable or enable the irq while it is freed
+    disable_irq(gpioData->irq_number);
+    hrtimer_cancel(&gpioData->stormTimer);
+    gpioData->storming = false;
+    // free_irq expects the affinity hint to be cleared
+    irq_set_affinity_hint(gpioData->irq_number, NULL);
+    free_irq(gpioData->irq_number, gpioData);
+    // waking the freed irq thread is harmless
+    hrtimer_cancel(&gpioData->glitchTimer);
+}
+
+static void software_ts_pause(struct gpio_data* gpioData)
+{
+    disable_irq(gpioData->irq_number);
+    storm_stop(gpioData);
+    // the glitch timer may still wake the irq thread, which then commits the
+    // held back edge without arming the timer again
+    hrtimer_cancel(&gpioData->glitchTimer);
+    synchronize_irq(gpioData->irq_number);
+}
+
+static void software_ts_resume(struct gpio_data* gpioData)
+{
+    enable_irq(gpioData->irq_number);
+}
+
+static void software_ts_kick(struct gpio_data* gpioData)
+{
+    irq_wake_thread(gpioData->irq_number, gpioData);
+}
+
+/* the irq thread follows the affinity of the irq */
+static int software_ts_set_affinity(struct gpio_data* gpioData, int cpu)
+{
+    return irq_set_affinity_hint(gpioData->irq_number,
+            cpu < 0 ? NULL : cpumask_of(cpu));
+}
+
+static ktime_t software_ts_now(struct gpio_data* gpioData)
+{
+    return clock_now(gpioData->config.clock);
+}
+
+#if IS_ENABLED(CONFIG_HTE)
+/*
+ * Hardware timestamps from the hardware timestamping engine of the gpio
+ * controller. The engine's callback stages the edge like gpio_irq_handler,
+ * its second callback drains the staging slots like gpio_irq_thread.
+ */
+static enum hte_return gpio_hte_handler(struct hte_ts_data* ts, void* data)
+{
+    struct gpio_data* gpio_data = (struct gpio_data*) data;
+    // the raw level is physical, the captured one logical like gpiod's
+    bool level = ts->raw_level >= 0 ? (ts->raw_level > 0)
+                != gpiod_is_active_low(gpio_data->desc)
+            : edge_level(gpio_data);
+
+    stage_edge(gpio_data, ns_to_ktime(ts->tsc), level);
+
+    return HTE_RUN_SECOND_CB;
+}
+
+static enum hte_return gpio_hte_thread(void* data)
+{
+    drain_staging((struct gpio_data*) data);
+
+    return HTE_CB_HANDLED;
+}
+
+static int hte_ts_start(struct gpio_data* gpioData)
+{
+    static const unsigned long edges[] = {
+        [IRQTS_EDGE_BOTH]       = HTE_RISING_EDGE_TS | HTE_FALLING_EDGE_TS,
+        [IRQTS_EDGE_RISING]     = HTE_RISING_EDGE_TS,
+        [IRQTS_EDGE_FALLING]    = HTE_FALLING_EDGE_TS,
+    };
+    int status;
+
+    // providers map the global gpio number to their line, like gpiolib-cdev
+    status = hte_init_line_attr(&gpioData->hteDesc,
+            desc_to_gpio(gpioData->desc), edges[line_edge(gpioData)],
+            gpioData->class_attr_gpio.attr.name, gpioData->desc);
+    if (status < 0)
+    {
+        return status;
+    }
+    status = hte_ts_get(NULL, &gpioData->hteDesc, 0);
+    if (status < 0)
+    {
+        return status;
+    }
+    status = hte_request_ts_ns(&gpioData->hteDesc, gpio_hte_handler,
+            gpio_hte_thread, gpioData);
+    if (status < 0)
+    {
+        hte_ts_put(&gpioData->hteDesc);
+    }
+    return status;
+}
+
+static void hte_ts_stop(struct gpio_data* gpioData)
+{
+    hte_ts_put(&gpioData->hteDesc);
+}
+#endif
+
+/* timestamp sources, indexed by enum gpio_timestamp */
+static const struct timestamp_source timestamp_sources[] = {
+    [GPIO_TIMESTAMP_SOFTWARE] = {
+        .name   = "software",
+        .start  = software_ts_start,
+        .stop   = software_ts_stop,
+        .pause  = software_ts_pause,
+        .resume = software_ts_resume,
+        .kick   = software_ts_kick,
+        .set_affinity = software_ts_set_affinity,
+        .now    = software_ts_now,
+    },
+#if IS_ENABLED(CONFIG_HTE)
+    // releasing the timestamps is the only way to wait for the callbacks
+    [GPIO_TIMESTAMP_HTE] = {
+        .name   = "hte",
+        .start  = hte_ts_start,
+        .stop   = hte_ts_stop,
+    },
+#endif
+};
+
+/*
+ * Returns true if config uses options only software timestamps support: the
+ * storm guard runs in their irq handler, and the priority is that of their
+ * irq thread, where hte drains from a shared workqueue.
+ */
+static bool software_only_config(const struct gpio_config* config)
+{
+    return config->stormRate > 0 || config->samplePeriod > 0
+            || config->priority > 0;
+}
+
+/*
+ * Returns the current time on the clock of the timestamps of a source, or 0
+ * if the source cannot read it, which saturates the first delta after.
+ */
+static ktime_t source_now(const struct timestamp_source* source,
+        struct gpio_data* gpioData)
+{
+    return source->now != NULL ? source->now(gpioData) : 0;
+}
+
+/*
+ * Starts capturing edges of a gpio from the requested timestamp source.
+ * GPIO_TIMESTAMP_AUTO picks hardware timestamps if the gpio supports them,
+ * and software timestamps otherwise.
+ */
+static int start_timestamp_source(struct gpio_data* gpioData,
+        enum gpio_timestamp timestamp)
+{
+    int id;
+    int status = -ENODEV;
+
+    // try sources from the last, so hardware timestamps are preferred
+    for (id = ARRAY_SIZE(timestamp_sources) - 1; id >= 0; id--)
+    {
+        if (timestamp_sources[id].start == NULL
+                || (timestamp != GPIO_TIMESTAMP_AUTO && timestamp != id)
+                || (gpioData->config.cpu >= 0
+                    && timestamp_sources[id].set_affinity == NULL)
+                || (id != GPIO_TIMESTAMP_SOFTWARE
+                    && software_only_config(&gpioData->config))
+                // members of a capture group share the source of the first
+                || (gpioData->group != NULL
+                    && gpioData->group->tsSource != NULL
+                    && gpioData->group->tsSource != &timestamp_sources[id]))
+        {
+            continue;
+        }
+        gpioData->lastInterruptTime = source_now(&timestamp_sources[id],
+                gpioData);
+        status = timestamp_sources[id].start(gpioData);
+        if (status < 0)
+        {
+            continue;
+        }
+        if (gpioData->config.cpu >= 0)
+        {
+            status = timestamp_sources[id].set_affinity(gpioData,
+                    gpioData->config.cpu);
+            if (status < 0)
+            {
+                timestamp_sources[id].stop(gpioData);
+                return status;
+            }
+        }
+        gpioData->tsSource = &timestamp_sources[id];
+        gpioData->config.timestamp = id;
+        if (gpioData->group != NULL)
+        {
+            gpioData->group->tsSource = gpioData->tsSource;
+        }
+        gpioData->capturing = true;
+        gpioData->threadPriority = 0;
+        return 0;
+    }
+    return status;
+}
+
+/*
+ * Stops capturing edges of a gpio, waiting for running handlers.
+ */
+static void stop_timestamp_source(struct gpio_data* gpioData)
+{
+    if (gpioData->capturing)
+    {
+        gpioData->tsSource->stop(gpioData);
+        gpioData->capturing = false;
+    }
+    hrtimer_cancel(&gpioData->idleTimer);
+}
+
+/*
+ * Holds off capture of a gpio while its ring is replaced, waiting for
+ * running handlers. Sources that cannot pause are stopped instead. Returns
+ * false if the source was not capturing. Must be called with configLock
+ * held.
+ */
+static bool pause_timestamp_source(struct gpio_data* gpioData)
+{
+    if (!gpioData->capturing)
+    {
+        return false;
+    }
+    if (gpioData->tsSource->pause != NULL)
+    {
+        gpioData->tsSource->pause(gpioData);
+    }
+    else
+    {
+        stop_timestamp_source(gpioData);
+    }
+    // the ring may be replaced, which the idle timer must not touch
+    hrtimer_cancel(&gpioData->idleTimer);
+    return true;
+}
+
+static void resume_timestamp_source(struct gpio_data* gpioData)
+{
+    if (gpioData->tsSource->resume != NULL)
+    {
+        gpioData->tsSource->resume(gpioData);
+    }
+    else if (gpioData->tsSource->start(gpioData) == 0)
+    {
+        gpioData->capturing = true;
+        gpioData->threadPriority = 0;
+    }
+    else
+    {
+        printk(KERN_ERR "irq_timings: error restarting %s timestamps on gpio%u\n",
+                gpioData->tsSource->name, gpioData->gpio);
+    }
+}
+
+#ifdef IRQTS_BENCH
+/*
+ * Synthetic edge injector, built with "make BENCH=y". Writing
+ * "PERIOD [PATTERN]" to /sys/kernel/debug/{CLASS_NAME}/bench pauses the
+ * timestamp source of every registered pin and stages edges PERIOD ns apart
+ * from an hrtimer in hard irq context, through the same path as the irq
+ * handler. Writing "0" stops. Reading reports the sustained rate.
+ */
+#define INJECT_TICK     (10 * NSEC_PER_USEC)    // min ns between timer runs
+#define INJECT_BURST    64      // edges per burst of the burst pattern
+
+/* patterns of the injected edges */
+enum {
+    INJECT_SQUARE,  // one edge every period
+    INJECT_JITTER,  // period apart on average, uniformly jittered by +-50%
+    INJECT_BURST_PATTERN,   // bursts of edges a period apart, idle between
+};
+
+static const char* const inject_names[] = {
+    [INJECT_SQUARE]         = "square",
+    [INJECT_JITTER]         = "jitter",
+    [INJECT_BURST_PATTERN]  = "burst",
+};
+
+/* Returns the ns from the current to the next injected edge. */
+static inline u64 inject_interval(struct gpio_data* gpio_data)
+{
+    u32 period = gpio_data->injectPeriod;
+
+    switch (gpio_data->injectPattern)
+    {
+    case INJECT_JITTER:
+        return period / 2 + get_random_u32() % period;
+    case INJECT_BURST_PATTERN:
+        // idle for the length of a burst after each one
+        return gpio_data->injected % INJECT_BURST == 0
+                ? (u64) period * INJECT_BURST : period;
+    default:
+        return period;
+    }
+}
+
+/*
+ * Stages the edges due since the last run and wakes up the irq thread. At
+ * most STAGING_SIZE edges are staged per run; an injector further behind
+ * skips ahead, so the rate is limited by what the irq thread sustains.
+ */
+static enum hrtimer_restart inject_timer_expired(struct hrtimer* timer)
+{
+    struct gpio_data* gpio_data = container_of(timer, struct gpio_data,
+            injectTimer);
+    ktime_t timeNow = ktime_get();
+    ktime_t offset = 0;
+    unsigned int count;
+
+    // edges are due on CLOCK_MONOTONIC, the clock of the timer
+    if (gpio_data->config.clock != IRQTS_CLOCK_MONOTONIC)
+    {
+        offset = ktime_sub(clock_now(gpio_data->config.clock), timeNow);
+    }
+
+    for (count = 0; count < STAGING_SIZE
+            && ktime_compare(gpio_data->injectNext, timeNow) <= 0; count++)
+    {
+        // pins capturing a single edge only see that edge
+        if (gpio_data->config.edge != IRQTS_EDGE_BOTH)
+        {
+            gpio_data->injectLevel = gpio_data->config.edge
+                    == IRQTS_EDGE_RISING;
+        }
+        stage_edge(gpio_data, ktime_add(gpio_data->injectNext, offset),
+                gpio_data->injectLevel);
+        gpio_data->injectLevel = !gpio_data->injectLevel;
+        gpio_data->injected++;
+        gpio_data->injectNext = ktime_add_ns(gpio_data->injectNext,
+                inject_interval(gpio_data));
+    }
+    if (ktime_compare(gpio_data->injectNext, timeNow) < 0)
+    {
+        gpio_data->injectNext = timeNow;
+    }
+    gpio_data->injectCost += ktime_to_ns(ktime_sub(ktime_get(), timeNow));
+    record_handler_latency(timeNow, IRQTS_CLOCK_MONOTONIC);
+    gpio_data->tsSource->kick(gpio_data);
+
+    hrtimer_set_expires(timer, ktime_compare(gpio_data->injectNext,
+                ktime_add_ns(timeNow, INJECT_TICK)) > 0
+            ? gpio_data->injectNext : ktime_add_ns(timeNow, INJECT_TICK));
+    return HRTIMER_RESTART;
+}
+
+/*
+ * Stops injecting edges into a gpio and resumes its timestamp source. Must
+ * be called with configLock held.
+ */
+static void bench_stop(struct gpio_data* gpioData)
+{
+    if (!gpioData->injecting)
+    {
+        return;
+    }
+    hrtimer_cancel(&gpioData->injectTimer);
+    gpioData->injectEnd = ktime_get();
+    gpioData->injecting = false;
+    resume_timestamp_source(gpioData);
+}
+
+/*
+ * Pauses the timestamp source of a gpio and injects edges period ns apart
+ * in its place. Needs a source that can be paused and kicked. Must be
+ * called with configLock held.
+ */
+static int bench_start(struct gpio_data* gpioData, u32 period, u8 pattern)
+{
+    ktime_t timeNow;
+
+    bench_stop(gpioData);
+    if (gpioData->tsSource->pause == NULL || gpioData->tsSource->kick == NULL)
+    {
+        return -EOPNOTSUPP;
+    }
+    if (!pause_timestamp_source(gpioData))
+    {
+        return -ENODEV;
+    }
+    timeNow = ktime_get();
+    gpioData->injectPeriod = period;
+    gpioData->injectPattern = pattern;
+    gpioData->injectNext = timeNow;
+    gpioData->injectStart = timeNow;
+    gpioData->injected = 0;
+    gpioData->injectCost = 0;
+    gpioData->injectCaptured = READ_ONCE(gpioData->edgesCaptured);
+    gpioData->injectDropped = READ_ONCE(gpioData->stagingOverruns);
+    gpioData->injectOverwritten = READ_ONCE(gpioData->edgesOverwritten);
+    gpioData->injectRejected = READ_ONCE(gpioData->edgesRejected);
+    gpioData->injecting = true;
+    hrtimer_start(&gpioData->injectTimer, timeNow, HRTIMER_MODE_ABS_HARD);
+    return 0;
+}
+
+static inline bool bench_injecting(struct gpio_data* gpioData)
+{
+    return gpioData->injecting;
+}
+
+static inline void bench_init_gpio(struct gpio_data* gpioData)
+{
+    hrtimer_init(&gpioData->injectTimer, CLOCK_MONOTONIC,
+            HRTIMER_MODE_ABS_HARD);
+    gpioData->injectTimer.function = inject_timer_expired;
+}
+
+/**
+ * Invoked when read from /sys/kernel/debug/{CLASS_NAME}/bench
+ */
+static int bench_show(struct seq_file* s, void* unused)
+{
+    struct gpio_data* gpioData;
+    unsigned long gpio;
+    unsigned long captured;
+    unsigned long dropped;
+    unsigned long overwritten;
+    unsigned long rejected;
+    unsigned long injected;
+    u64 elapsed;
+
+    seq_puts(s, "gpio pattern period_ns elapsed_ns injected captured dropped"
+            " overwritten rejected edges_per_sec lost_ppm"
+            " inject_ns_per_edge\n");
+    mutex_lock(&registry_lock);
+    xa_for_each(&registered_gpios, gpio, gpioData)
+    {
+        mutex_lock(&gpioData->configLock);
+        if (gpioData->injectPeriod == 0)
+        {
+            mutex_unlock(&gpioData->configLock);
+            continue;
+        }
+        // the irq thread still drains the last staged edges after a stop
+        elapsed = ktime_to_ns(ktime_sub(gpioData->injecting ? ktime_get()
+                    : gpioData->injectEnd, gpioData->injectStart));
+        captured = READ_ONCE(gpioData->edgesCaptured)
+                - gpioData->injectCaptured;
+        dropped = READ_ONCE(gpioData->stagingOverruns)
+                - gpioData->injectDropped;
+        overwritten = READ_ONCE(gpioData->edgesOverwritten)
+                - gpioData->injectOverwritten;
+        rejected = READ_ONCE(gpioData->edgesRejected)
+                - gpioData->injectRejected;
+        injected = READ_ONCE(gpioData->injected);
+        // edges overwritten before a reader took them are lost as well
+        captured -= min(captured, overwritten);
+        seq_printf(s, "%lu %s %u %llu %lu %lu %lu %lu %lu %llu %llu %llu\n",
+                gpio, inject_names[gpioData->injectPattern],
+                gpioData->injectPeriod, elapsed, injected, captured, dropped,
+                overwritten, rejected,
+                elapsed > 0 ? div64_u64((u64) captured * NSEC_PER_SEC, elapsed)
+                    : 0,
+                injected > 0 ? div64_u64((u64) (dropped + overwritten
+                        + rejected) * 1000000, injected) : 0,
+                injected > 0 ? div64_u64(READ_ONCE(gpioData->injectCost),
+                    injected) : 0);
+        mutex_unlock(&gpioData->configLock);
+    }
+    mutex_unlock(&registry_lock);
+    return 0;
+}
+
+static int bench_open(struct inode* inode, struct file* file)
+{
+    return single_open(file, bench_show, NULL);
+}
+
+/**
+ * Invoked when write to /sys/kernel/debug/{CLASS_NAME}/bench
+ */
+static ssize_t bench_write(struct file* file, const char __user* buf,
+        size_t count, loff_t* offset)
+{
+    struct gpio_data* gpioData;
+    unsigned long gpio;
+    char input[32] = { 0 };
+    char* options = input;
+    char* pattern;
+    unsigned int period;
+    int index = INJECT_SQUARE;
+    int status = 0;
+
+    // read period and pattern from input, "PERIOD [PATTERN]"
+    if (count >= sizeof(input) || copy_from_user(input, buf, count) != 0)
+    {
+        return -EINVAL;
+    }
+    options = strim(input);
+    if (kstrtouint(strsep(&options, " \t"), 0, &period) < 0)
+    {
+        return -EINVAL;
+    }
+    pattern = options != NULL ? strim(options) : NULL;
+    if (pattern != NULL && *pattern != '\0')
+    {
+        index = sysfs_match_string(inject_names, pattern);
+        if (index < 0)
+        {
+            return -EINVAL;
+        }
+    }
+
+    mutex_lock(&registry_lock);
+    xa_for_each(&registered_gpios, gpio, gpioData)
+    {
+        mutex_lock(&gpioData->configLock);
+        if (period == 0)
+        {
+            bench_stop(gpioData);
+        }
+        else if (bench_start(gpioData, period, index) < 0)
+        {
+            printk(KERN_WARNING "irq_timings: cannot inject edges into gpio%lu\n",
+                    gpio);
+            status = -EOPNOTSUPP;
+        }
+        mutex_unlock(&gpioData->configLock);
+    }
+    mutex_unlock(&registry_lock);
+
+    return status < 0 ? status : count;
+}
+
+/* file operations of /sys/kernel/debug/{CLASS_NAME}/bench */
+static const struct file_operations bench_fops = {
+    .owner      = THIS_MODULE,
+    .open       = bench_open,
+    .read       = seq_read,
+    .write      = bench_write,
+    .llseek     = seq_lseek,
+    .release    = single_release,
+};
+
+static void bench_init(void)
+{
+    debugfs_create_file("bench", 0644, debugfs_dir, NULL, &bench_fops);
+}
+#else
+static inline void bench_stop(struct gpio_data* gpioData) { }
+static inline bool bench_injecting(struct gpio_data* gpioData) { return false; }
+static inline void bench_init_gpio(struct gpio_data* gpioData) { }
+static inline void bench_init(void) { }
+#endif
+
+#if defined(IRQTS_LATENCY_STATS) || defined(IRQTS_BENCH)
+static void debug_files_init(void)
+{
+    debugfs_dir = debugfs_create_dir(CLASS_NAME, NULL);
+    latency_stats_init();
+    bench_init();
+}
+
+static void debug_files_exit(void)
+{
+    debugfs_remove_recursive(debugfs_dir);
+}
+#else
+static inline void debug_files_init(void) { }
+static inline void debug_files_exit(void) { }
+#endif
+
+
+/**
+ * Invoked when read from /sys/class/{CLASS_NAME}/gpio{GPIO_ID}
+ */
+static ssize_t gpio_show(struct class* class, struct class_attribute* class_attr,
+        char* buf)
+{
+    // attribute file is removed before its gpio data is released
+    struct gpio_data* gpioData = container_of(class_attr, struct gpio_data,
+            class_attr_gpio);
+    size_t count;
+    size_t bufI;
+    unsigned int written = 0;
+    int status;
+
+    // retrieve the oldest full buffer of timings from the ring
+    if (mutex_lock_interruptible(&gpioData->readLock) < 0)
+    {
+        return -ERESTARTSYS;
+    }
+    // the writeback worker consumes the ring alone
+    if (gpioData->wbFile != NULL)
+    {
+        mutex_unlock(&gpioData->readLock);
+        return -EBUSY;
+    }
+    // take only the timings whose lines surely fit, the rest stays unread
+    count = min_t(size_t, gpioData->config.batchSize, (PAGE_SIZE - 1)
+            / (ring_entry_size(&gpioData->ring) == sizeof(u64)
+                ? SHOW_LINE64 : SHOW_LINE32));
+    if (ring_count(&gpioData->ring) < count)
+    {
+        // or the timings of a frame ended by an idle gap
+        count = min_t(size_t, closed_frame_count(gpioData), count);
+        if (count == 0)
+        {
+            mutex_unlock(&gpioData->readLock);
+            return 0;
+        }
+    }
+    count = read_timings(gpioData, count);
+
+    // generate timings string, with a line reading "drop" for drop markers
+    // and "sampled" or "interrupts" for capture mode changes
+    for (bufI = 0; bufI < count; bufI++)
+    {
+        if (ring_entry_size(&gpioData->ring) == sizeof(u64)
+                ? ((u64*) gpioData->readBuf)[bufI] == IRQTS_DROP64
+                : ((u32*) gpioData->readBuf)[bufI] == IRQTS_DROP32)
+        {
+            status = scnprintf((buf + written), PAGE_SIZE - written, "drop\n");
+        }
+        else if (ring_entry_size(&gpioData->ring) == sizeof(u64)
+                ? IRQTS_TIMING64(((u64*) gpioData->readBuf)[bufI])
+                    == IRQTS_MODE64
+                : IRQTS_TIMING32(((u32*) gpioData->readBuf)[bufI])
+                    == IRQTS_MODE32)
+        {
+            status = scnprintf((buf + written), PAGE_SIZE - written, "%s\n",
+                    ring_entry_size(&gpioData->ring) == sizeof(u64)
+                    ? (((u64*) gpioData->readBuf)[bufI] & IRQTS_LEVEL64
+                        ? "sampled" : "interrupts")
+                    : (((u32*) gpioData->readBuf)[bufI] & IRQTS_LEVEL32
+                        ? "sampled" : "interrupts"));
+        }
+        else if (ring_entry_size(&gpioData->ring) == sizeof(u64))
+        {
+            status = scnprintf((buf + written), PAGE_SIZE - written,
+                    "%llu\n", IRQTS_TIMING64(((u64*) gpioData->readBuf)[bufI]));
+        }
+        else
+        {
+            status = scnprintf((buf + written), PAGE_SIZE - written, "%u\n",
+                    IRQTS_TIMING32(((u32*) gpioData->readBuf)[bufI]));
+        }
+        if (status >= 0)
+        {
+            written += status;
+        }
+        else
+        {
+            printk(KERN_ERR "Error reading entire timings buffer\n");
+            break;
+        }
+    }
+    mutex_unlock(&gpioData->readLock);
+
+    return written;
+}
+
+/* struct representing the position of a merged device reader in a pin */
+struct merge_position {
+    u32 generation; // ringGeneration of the ring the position is in
+    u32 position;
+    bool dropped;
+};
+
+/* struct representing a pin merged by one read of the merged device */
+struct merge_pin {
+    struct gpio_data* gpioData;
+    struct merge_position* position;
+    u64 next;   // oldest unread entry, if hasNext
+    bool hasNext;
+};
+
+/* struct representing an open file of the merged device */
+struct merge_reader {
+    struct mutex lock;  // serializes reads
+    struct xarray positions;    // gpio -> struct merge_position
+    bool all;
+    struct irqts_pin_mask mask;
+    int pollSeq;    // merge_seq at the last read
+    struct merge_pin pins[MERGE_MAX_PINS];
+    struct irqts_event buf[MERGE_BUF_SIZE];
+};
+
+/*
+ * Returns whether the reader merges the gpio.
+ */
+static bool merge_selected(const struct merge_reader* reader,
+        unsigned long gpio)
+{
+    return reader->all || (gpio < IRQTS_MASK_GPIOS
+            && (reader->mask.bits[gpio / 64] >> (gpio % 64)) & 1);
+}
+
+/*
+ * Pins the selected gpios, in the ns format and on the capture clock and
+ * timestamp source of the lowest of them, for one read. Their rings are
+ * not replaced while pinned, like while their gpio device is open. Returns
+ * the number of pins.
+ */
+static unsigned int merge_get_pins(struct merge_reader* reader)
+{
+    struct gpio_data* gpioData;
+    struct merge_position* position;
+    unsigned long gpio;
+    unsigned int count = 0;
+    unsigned int i;
+    unsigned int kept = 0;
+
+    // drop the positions of unregistered pins, registering anew starts over
+    xa_for_each(&reader->positions, gpio, position)
+    {
+        if (xa_load(&registered_gpios, gpio) == NULL)
+        {
+            xa_erase(&reader->positions, gpio);
+            kfree(position);
+        }
+    }
+
+    rcu_read_lock();
+    xa_for_each(&registered_gpios, gpio, gpioData)
+    {
+        if (count < MERGE_MAX_PINS && merge_selected(reader, gpio)
+                && kref_get_unless_zero(&gpioData->refcount))
+        {
+            reader->pins[count++].gpioData = gpioData;
+        }
+    }
+    rcu_read_unlock();
+
+    for (i = 0; i < count; i++)
+    {
+        gpioData = reader->pins[i].gpioData;
+        mutex_lock(&gpioData->configLock);
+        gpioData->openCount++;
+        mutex_unlock(&gpioData->configLock);
+
+        // find position in the pin, new pins start at their oldest timing
+        position = xa_load(&reader->positions, gpioData->gpio);
+        if (position == NULL)
+        {
+            position = kzalloc(sizeof(struct merge_position), GFP_KERNEL);
+            if (position != NULL && xa_insert(&reader->positions,
+                        gpioData->gpio, position, GFP_KERNEL) < 0)
+            {
+                kfree(position);
+                position = NULL;
+            }
+        }
+        // only pins on the clock and source of the first merged pin are
+        // ordered, hardware timestamps are on the clock of their engine
+        if (position == NULL || gpioData->config.format != IRQTS_FORMAT_NS
+                || (kept > 0 && (gpioData->config.clock
+                        != reader->pins[0].gpioData->config.clock
+                    || gpioData->tsSource
+                        != reader->pins[0].gpioData->tsSource))
+                || READ_ONCE(gpioData->removed))
+        {
+            mutex_lock(&gpioData->configLock);
+            gpioData->openCount--;
+            mutex_unlock(&gpioData->configLock);
+            kref_put(&gpioData->refcount, release_gpio_data);
+            continue;
+        }
+        if (position->generation != gpioData->ringGeneration)
+        {
+            position->generation = gpioData->ringGeneration;
+            position->position = smp_load_acquire(
+                    &gpioData->ring.header->head);
+            position->position -= min(position->position,
+                    ring_capacity(&gpioData->ring));
+        }
+        reader->pins[kept].gpioData = gpioData;
+        reader->pins[kept].position = position;
+        reader->pins[kept].hasNext = false;
+        kept++;
+    }
+    return kept;
+}
+
+/*
+ * Releases the pins of a read.
+ */
+static void merge_put_pins(struct merge_reader* reader, unsigned int count)
+{
+    struct gpio_data* gpioData;
+    unsigned int i;
+
+    for (i = 0; i < count; i++)
+    {
+        gpioData = reader->pins[i].gpioData;
+        mutex_lock(&gpioData->configLock);
+        gpioData->openCount--;
+        mutex_unlock(&gpioData->configLock);
+        kref_put(&gpioData->refcount, release_gpio_data);
+    }
+}
+
+/*
+ * Loads the oldest unread entry of a pin into next, skipping drop markers
+ * and overwritten entries. The ring is only read, not consumed. Returns
+ * whether an entry was unread.
+ */
+static bool merge_peek(struct merge_pin* pin)
+{
+    struct timings_ring* ring = &pin->gpioData->ring;
+    struct merge_position* position = pin->position;
+    u32 capacity = ring_capacity(ring);
+    u32 head;
+
+    for (;;)
+    {
+        head = smp_load_acquire(&ring->header->head);
+        if (head - position->position > capacity)
+        {
+            position->position = head - capacity;
+            position->dropped = true;
+        }
+        if (position->position == head)
+        {
+            return false;
+        }
+        pin->next = ((u64*) ring->entries)[position->position & ring->mask];
+
+        // retry if the producer overwrote the entry while it was read
+        smp_rmb();
+        if (READ_ONCE(ring->header->head) - position->position > capacity)
+        {
+            continue;
+        }
+        // capture mode changes mark edges that may be lost as well
+        if (pin->next == IRQTS_DROP64
+                || IRQTS_TIMING64(pin->next) == IRQTS_MODE64)
+        {
+            position->position++;
+            position->dropped = true;
+            continue;
+        }
+        pin->hasNext = true;
+        return true;
+    }
+}
+
+/*
+ * Copies up to max events of the pins to userspace, oldest first. Returns
+ * the number of events copied or a negative error.
+ */
+static ssize_t merge_events(struct merge_reader* reader, unsigned int count,
+        struct irqts_event __user* buf, size_t max)
+{
+    struct merge_pin* oldest;
+    struct irqts_event* event;
+    size_t total = 0;
+    size_t buffered = 0;
+    unsigned int i;
+
+    for (i = 0; i < count; i++)
+    {
+        merge_peek(&reader->pins[i]);
+    }
+    while (total + buffered < max)
+    {
+        // pick the pin with the oldest unread edge, few pins are merged
+        oldest = NULL;
+        for (i = 0; i < count; i++)
+        {
+            if (reader->pins[i].hasNext && (oldest == NULL
+                        || IRQTS_TIMING64(reader->pins[i].next)
+                           < IRQTS_TIMING64(oldest->next)))
+            {
+                oldest = &reader->pins[i];
+            }
+        }
+        if (oldest == NULL)
+        {
+            break;
+        }
+
+        event = &reader->buf[buffered++];
+        event->timestamp = oldest->next;
+        event->gpio = oldest->gpioData->gpio;
+        event->flags = oldest->position->dropped ? IRQTS_EVENT_DROPPED : 0;
+        oldest->position->dropped = false;
+        oldest->position->position++;
+        oldest->hasNext = false;
+        merge_peek(oldest);
+
+        if (buffered == MERGE_BUF_SIZE)
+        {
+            if (copy_to_user(buf + total, reader->buf,
+                        buffered * sizeof(struct irqts_event)) != 0)
+            {
+                return -EFAULT;
+            }
+            total += buffered;
+            buffered = 0;
+        }
+    }
+    if (copy_to_user(buf + total, reader->buf,
+                buffered * sizeof(struct irqts_event)) != 0)
+    {
+        return -EFAULT;
+    }
+    return total + buffered;
+}
+
+/**
+ * Invoked when /dev/{CLASS_NAME}/all is opened
+ */
+static int merge_dev_open(struct inode* inode, struct file* file)
+{
+    struct merge_reader* reader;
+    unsigned int count;
+    unsigned int i;
+
+    reader = kvzalloc(sizeof(struct merge_reader), GFP_KERNEL);
+    if (reader == NULL)
+    {
+        return -ENOMEM;
+    }
+    mutex_init(&reader->lock);
+    xa_init(&reader->positions);
+    reader->all = true;
+
+    // start at the newest timing of the pins registered now
+    count = merge_get_pins(reader);
+    for (i = 0; i < count; i++)
+    {
+        reader->pins[i].position->position = smp_load_acquire(
+                &reader->pins[i].gpioData->ring.header->head);
+    }
+    merge_put_pins(reader, count);
+    reader->pollSeq = atomic_read(&merge_seq);
+    atomic_inc(&merge_readers);
+
+    file->private_data = reader;
+    return nonseekable_open(inode, file);
+}
+
+/**
+ * Invoked when /dev/{CLASS_NAME}/all is closed
+ */
+static int merge_dev_release(struct inode* inode, struct file* file)
+{
+    struct merge_reader* reader = file->private_data;
+    struct merge_position* position;
+    unsigned long gpio;
+
+    atomic_dec(&merge_readers);
+    xa_for_each(&reader->positions, gpio, position)
+    {
+        kfree(position);
+    }
+    xa_destroy(&reader->positions);
+    kvfree(reader);
+    return 0;
+}
+
+/**
+ * Invoked when read from /dev/{CLASS_NAME}/all. Blocks until at least one
+ * event is unread.
+ */
+static ssize_t merge_dev_read(struct file* file, char __user* buf,
+        size_t size, loff_t* offset)
+{
+    struct merge_reader* reader = file->private_data;
+    size_t max = size / sizeof(struct irqts_event);
+    unsigned int count;
+    ssize_t total;
+    int seq;
+
+    if (max == 0)
+    {
+        return -EINVAL;
+    }
+    if (mutex_lock_interruptible(&reader->lock) < 0)
+    {
+        return -ERESTARTSYS;
+    }
+    for (;;)
+    {
+        seq = atomic_read(&merge_seq);
+        count = merge_get_pins(reader);
+        total = merge_events(reader, count,
+                (struct irqts_event __user*) buf, max);
+        merge_put_pins(reader, count);
+        WRITE_ONCE(reader->pollSeq, seq);
+        if (total != 0 || (file->f_flags & O_NONBLOCK))
+        {
+            break;
+        }
+        if (wait_event_interruptible(merge_wait,
+                    atomic_read(&merge_seq) != seq) < 0)
+        {
+            total = -ERESTARTSYS;
+            break;
+        }
+    }
+    mutex_unlock(&reader->lock);
+
+    if (total == 0)
+    {
+        return -EAGAIN;
+    }
+    return total < 0 ? total : total * sizeof(struct irqts_event);
+}
+
+/**
+ * Invoked when /dev/{CLASS_NAME}/all is polled. Reports the device readable
+ * whenever edges were captured since the last read.
+ */
+static __poll_t merge_dev_poll(struct file* file, poll_table* wait)
+{
+    struct merge_reader* reader = file->private_data;
+
+    poll_wait(file, &merge_wait, wait);
+    return atomic_read(&merge_seq) != READ_ONCE(reader->pollSeq)
+            ? EPOLLIN | EPOLLRDNORM : 0;
+}
+
+/**
+ * Invoked on ioctl of /dev/{CLASS_NAME}/all
+ */
+static long merge_dev_ioctl(struct file* file, unsigned int cmd,
+        unsigned long arg)
+{
+    struct merge_reader* reader = file->private_data;
+    struct irqts_pin_mask mask;
+
+    switch (cmd)
+    {
+    case IRQTS_IOC_SELECT:
+        if (copy_from_user(&mask, (void __user*) arg, sizeof(mask)) != 0)
+        {
+            return -EFAULT;
+        }
+        mutex_lock(&reader->lock);
+        reader->mask = mask;
+        reader->all = false;
+        mutex_unlock(&reader->lock);
+        return 0;
+    case IRQTS_IOC_SELECT_ALL:
+        mutex_lock(&reader->lock);
+        reader->all = true;
+        mutex_unlock(&reader->lock);
+        return 0;
+    default:
+        return -ENOTTY;
+    }
+}
+
+static const struct file_operations merge_dev_fops = {
+    .owner          = THIS_MODULE,
+    .open           = merge_dev_open,
+    .release        = merge_dev_release,
+    .read           = merge_dev_read,
+    .poll           = merge_dev_poll,
+    .unlocked_ioctl = merge_dev_ioctl,
+    .compat_ioctl   = compat_ptr_ioctl,
+    .llseek         = no_llseek
+};
+
+/* struct representing an open capture group device */
+struct group_reader {
+    struct capture_group* group;
+    struct mutex lock;  // serializes reads
+    u32 position;   // ring position of the next event
+    struct irqts_group_event buf[GROUP_BUF_SIZE];
+};
+
+/*
+ * Copies up to max unread events of a group into the buffer of a reader,
+ * skipping overwritten ones, and returns their count. Must be called with
+ * the lock of the reader held.
+ */
+static unsigned int group_copy(struct group_reader* reader, unsigned int max)
+{
+    struct capture_group* group = reader->group;
+    unsigned long flags;
+    unsigned int count;
+    unsigned int i;
+    bool lost = false;
+
+    raw_spin_lock_irqsave(&group->lock, flags);
+    if (group->head - reader->position > GROUP_RING_SIZE)
+    {
+        reader->position = group->head - GROUP_RING_SIZE;
+        lost = true;
+    }
+    count = min3(group->head - reader->position, max, (u32) GROUP_BUF_SIZE);
+    for (i = 0; i < count; i++)
+    {
+        reader->buf[i] = group->events[(reader->position + i)
+                & (GROUP_RING_SIZE - 1)];
+    }
+    raw_spin_unlock_irqrestore(&group->lock, flags);
+
+    if (lost && count > 0)
+    {
+        reader->buf[0].flags |= IRQTS_EVENT_DROPPED;
+    }
+    reader->position += count;
+    return count;
+}
+
+/**
+ * Invoked when /dev/{CLASS_NAME}/group{GROUP_ID} is opened
+ */
+static int group_dev_open(struct inode* inode, struct file* file)
+{
+    struct group_reader* reader;
+
+    reader = kzalloc(sizeof(struct group_reader), GFP_KERNEL);
+    if (reader == NULL)
+    {
+        return -ENOMEM;
+    }
+    mutex_init(&reader->lock);
+    reader->group = &capture_groups[iminor(inode) - GROUP_MINOR];
+    // start at the newest event
+    reader->position = READ_ONCE(reader->group->head);
+
+    file->private_data = reader;
+    return nonseekable_open(inode, file);
+}
+
+/**
+ * Invoked when /dev/{CLASS_NAME}/group{GROUP_ID} is closed
+ */
+static int group_dev_release(struct inode* inode, struct file* file)
+{
+    kfree(file->private_data);
+    return 0;
+}
+
+/**
+ * Invoked when read from /dev/{CLASS_NAME}/group{GROUP_ID}. Blocks until at
+ * least one event is unread.
+ */
+static ssize_t group_dev_read(struct file* file, char __user* buf,
+        size_t size, loff_t* offset)
+{
+    struct group_reader* reader = file->private_data;
+    struct capture_group* group = reader->group;
+    size_t max = size / sizeof(struct irqts_group_event);
+    size_t total = 0;
+    unsigned int count;
+    ssize_t status = 0;
+
+    if (max == 0)
+    {
+        return -EINVAL;
+    }
+    if (mutex_lock_interruptible(&reader->lock) < 0)
+    {
+        return -ERESTARTSYS;
+    }
+    while (total < max)
+    {
+        count = group_copy(reader, min_t(size_t, max - total, U32_MAX));
+        if (count > 0)
+        {
+            if (copy_to_user(buf + total * sizeof(struct irqts_group_event),
+                        reader->buf, count * sizeof(struct irqts_group_event))
+                    != 0)
+            {
+                status = -EFAULT;
+                break;
+            }
+            total += count;
+            continue;
+        }
+        if (total > 0 || (file->f_flags & O_NONBLOCK))
+        {
+            break;
+        }
+        if (wait_event_interruptible(group->wait,
+                    READ_ONCE(group->head) != reader->position) < 0)
+        {
+            status = -ERESTARTSYS;
+            break;
+        }
+    }
+    mutex_unlock(&reader->lock);
+
+    if (total > 0)
+    {
+        return total * sizeof(struct irqts_group_event);
+    }
+    return status < 0 ? status : -EAGAIN;
+}
+
+/**
+ * Invoked when /dev/{CLASS_NAME}/group{GROUP_ID} is polled
+ */
+static __poll_t group_dev_poll(struct file* file, poll_table* wait)
+{
+    struct group_reader* reader = file->private_data;
+
+    poll_wait(file, &reader->group->wait, wait);
+    return READ_ONCE(reader->group->head) != READ_ONCE(reader->position)
+            ? EPOLLIN | EPOLLRDNORM : 0;
+}
+
+/**
+ * Invoked on ioctl of /dev/{CLASS_NAME}/group{GROUP_ID}
+ */
+static long group_dev_ioctl(struct file* file, unsigned int cmd,
+        unsigned long arg)
+{
+    struct group_reader* reader = file->private_data;
+    struct irqts_group_members members;
+
+    switch (cmd)
+    {
+    case IRQTS_IOC_GROUP_MEMBERS:
+        mutex_lock(&registry_lock);
+        members.used = reader->group->used;
+        memcpy(members.gpios, reader->group->gpios, sizeof(members.gpios));
+        mutex_unlock(&registry_lock);
+        if (copy_to_user((void __user*) arg, &members, sizeof(members)) != 0)
+        {
+            return -EFAULT;
+        }
+        return 0;
+    default:
+        return -ENOTTY;
+    }
+}
+
+static const struct file_operations group_dev_fops = {
+    .owner          = THIS_MODULE,
+    .open           = group_dev_open,
+    .release        = group_dev_release,
+    .read           = group_dev_read,
+    .poll           = group_dev_poll,
+    .unlocked_ioctl = group_dev_ioctl,
+    .compat_ioctl   = compat_ptr_ioctl,
+    .llseek         = no_llseek
+};
+
+/*
+ * Creates the ring and device of a capture group. Must be called with
+ * registry_lock held.
+ */
+static int group_create(struct capture_group* group, unsigned int id)
+{
+    struct device* device;
+    int status;
+
+    group->events = kvcalloc(GROUP_RING_SIZE,
+            sizeof(struct irqts_group_event), GFP_KERNEL);
+    group->cdev = cdev_alloc();
+    if (group->events == NULL || group->cdev == NULL)
+    {
+        status = -ENOMEM;
+        goto GroupAllocError;
+    }
+    group->cdev->owner = THIS_MODULE;
+    group->cdev->ops = &group_dev_fops;
+    status = cdev_add(group->cdev,
+            MKDEV(MAJOR(driver_devt), GROUP_MINOR + id - 1), 1);
+    if (status < 0)
+    {
+        goto GroupAllocError;
+    }
+    device = device_create(&driver_class, NULL, group->cdev->dev, NULL,
+            "%s%u", GROUP_DEV_PREFIX, id);
+    if (IS_ERR(device))
+    {
+        cdev_del(group->cdev);
+        group->cdev = NULL;
+        status = PTR_ERR(device);
+        goto GroupAllocError;
+    }
+    group->device = device;
+    return 0;
+
+GroupAllocError:
+    if (group->cdev != NULL)
+    {
+        kobject_put(&group->cdev->kobj);
+        group->cdev = NULL;
+    }
+    kvfree(group->events);
+    group->events = NULL;
+    return status;
+}
+
+/*
+ * Adds a gpio to its configured capture group, before its timestamp source
+ * is started. Must be called with registry_lock held.
+ */
+static int group_join(struct gpio_data* gpioData)
+{
+    struct capture_group* group;
+    unsigned long flags;
+    unsigned int member;
+    u16 bit;
+    int status;
+
+    if (gpioData->config.group == 0)
+    {
+        return 0;
+    }
+    group = &capture_groups[gpioData->config.group - 1];
+    if (group->used == (u16) GENMASK(IRQTS_GROUP_PINS - 1, 0))
+    {
+        return -EBUSY;
+    }
+    // events of all members are ordered on one clock of one source
+    if (group->used != 0 && (gpioData->config.clock != group->clock
+                || (group->tsSource != NULL
+                    && gpioData->config.timestamp != GPIO_TIMESTAMP_AUTO
+                    && (gpioData->config.timestamp
+                            >= ARRAY_SIZE(timestamp_sources)
+                        || group->tsSource != &timestamp_sources[
+                            gpioData->config.timestamp]))))
+    {
+        return -EINVAL;
+    }
+    if (group->device == NULL)
+    {
+        status = group_create(group, gpioData->config.group);
+        if (status < 0)
+        {
+            return status;
+        }
+    }
+
+    member = ffz(group->used);
+    bit = BIT(member);
+    group->gpios[member] = gpioData->gpio;
+    raw_spin_lock_irqsave(&group->lock, flags);
+    if (group->used == 0)
+    {
+        // an empty group restarts its timebase with the new pin
+        group->clock = gpioData->config.clock;
+        group->tsSource = NULL;
+        group->lastTime = 0;
+    }
+    group->used |= bit;
+    group->levels = gpiod_get_value(gpioData->desc) > 0
+            ? group->levels | bit : group->levels & ~bit;
+    raw_spin_unlock_irqrestore(&group->lock, flags);
+    gpioData->groupMember = member;
+    gpioData->group = group;
+    return 0;
+}
+
+/*
+ * Removes a gpio from its capture group, after its timestamp source is
+ * stopped. Must be called with registry_lock held.
+ */
+static void group_leave(struct gpio_data* gpioData)
+{
+    struct capture_group* group = gpioData->group;
+    u16 bit = BIT(gpioData->groupMember);
+    unsigned long flags;
+
+    if (group == NULL)
+    {
+        return;
+    }
+    raw_spin_lock_irqsave(&group->lock, flags);
+    group->used &= ~bit;
+    group->levels &= ~bit;
+    raw_spin_unlock_irqrestore(&group->lock, flags);
+    gpioData->group = NULL;
+}
+
+static void group_init(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < IRQTS_GROUPS; i++)
+    {
+        raw_spin_lock_init(&capture_groups[i].lock);
+        init_waitqueue_head(&capture_groups[i].wait);
+    }
+}
+
+/* Removes the devices and rings of the capture groups. */
+static void group_exit(void)
+{
+    struct capture_group* group;
+    unsigned int i;
+
+    for (i = 0; i < IRQTS_GROUPS; i++)
+    {
+        group = &capture_groups[i];
+        if (group->device != NULL)
+        {
+            device_destroy(&driver_class, group->cdev->dev);
+            cdev_del(group->cdev);
+            kvfree(group->events);
+        }
+    }
+}
+
+/*
+ * Clock sync records of /dev/{CLASS_NAME}/clock_sync, see struct
+ * irqts_clock_sync. sync_work emits one every SYNC_PERIOD into a ring of the
+ * last SYNC_RING_SIZE records, readers keep their own position.
+ */
+static struct irqts_clock_sync sync_records[SYNC_RING_SIZE];
+static DEFINE_SPINLOCK(sync_lock);
+static u32 sync_head;   // records emitted so far, runs freely
+static DECLARE_WAIT_QUEUE_HEAD(sync_wait);
+static struct cdev* sync_cdev;
+static struct device* sync_device;
+
+/*
+ * Reads all capture clocks between two reads of CLOCK_REALTIME into record.
+ */
+static void sync_sample(struct irqts_clock_sync* record)
+{
+    unsigned long flags;
+    unsigned int clock;
+    ktime_t before;
+    ktime_t after;
+    s64 spread;
+
+    // keep the reads as close together as possible
+    local_irq_save(flags);
+    before = ktime_get_real();
+    for (clock = 0; clock < IRQTS_CLOCKS; clock++)
+    {
+        record->clocks[clock] = ktime_to_ns(clock_now(clock));
+    }
+    after = ktime_get_real();
+    local_irq_restore(flags);
+
+    // CLOCK_REALTIME set in between spoils the sample
+    spread = ktime_to_ns(ktime_sub(after, before));
+    record->realtime = ktime_to_ns(before) + spread / 2;
+    record->uncertainty = spread >= 0 && spread < U32_MAX ? spread : U32_MAX;
+}
+
+/* Emits a clock sync record and schedules the next one. */
+static void sync_work_run(struct work_struct* work)
+{
+    struct irqts_clock_sync record;
+
+    sync_sample(&record);
+    spin_lock(&sync_lock);
+    record.seq = sync_head;
+    sync_records[sync_head & (SYNC_RING_SIZE - 1)] = record;
+    sync_head++;
+    spin_unlock(&sync_lock);
+    wake_up_interruptible(&sync_wait);
+
+    schedule_delayed_work(to_delayed_work(work), SYNC_PERIOD);
+}
+
+static DECLARE_DELAYED_WORK(sync_work, sync_work_run);
+
+/* struct representing an open file of /dev/{CLASS_NAME}/clock_sync */
+struct sync_reader {
+    struct mutex lock;  // serializes reads
+    u32 position;   // ring position of the next record
+};
+
+/**
+ * Invoked when /dev/{CLASS_NAME}/clock_sync is opened
+ */
+static int sync_dev_open(struct inode* inode, struct file* file)
+{
+    struct sync_reader* reader;
+
+    reader = kzalloc(sizeof(struct sync_reader), GFP_KERNEL);
+    if (reader == NULL)
+    {
+        return -ENOMEM;
+    }
+    mutex_init(&reader->lock);
+    // start at the newest record
+    spin_lock(&sync_lock);
+    reader->position = sync_head > 0 ? sync_head - 1 : 0;
+    spin_unlock(&sync_lock);
+
+    file->private_data = reader;
+    return nonseekable_open(inode, file);
+}
+
+/**
+ * Invoked when /dev/{CLASS_NAME}/clock_sync is closed
+ */
+static int sync_dev_release(struct inode* inode, struct file* file)
+{
+    kfree(file->private_data);
+    return 0;
+}
+
+/**
+ * Invoked when read from /dev/{CLASS_NAME}/clock_sync. Blocks until at least
+ * one record is unread. Records overwritten before they were read are
+ * skipped, which shows as a gap in their seq.
+ */
+static ssize_t sync_dev_read(struct file* file, char __user* buf,
+        size_t size, loff_t* offset)
+{
+    struct sync_reader* reader = file->private_data;
+    size_t max = size / sizeof(struct irqts_clock_sync);
+    struct irqts_clock_sync record;
+    size_t total = 0;
+    ssize_t status = 0;
+    bool unread;
+
+    if (max == 0)
+    {
+        return -EINVAL;
+    }
+    if (mutex_lock_interruptible(&reader->lock) < 0)
+    {
+        return -ERESTARTSYS;
+    }
+    while (total < max)
+    {
+        spin_lock(&sync_lock);
+        unread = sync_head != reader->position;
+        if (unread)
+        {
+            if (sync_head - reader->position > SYNC_RING_SIZE)
+            {
+                reader->position = sync_head - SYNC_RING_SIZE;
+            }
+            record = sync_records[reader->position & (SYNC_RING_SIZE - 1)];
+        }
+        spin_unlock(&sync_lock);
+
+        if (unread)
+        {
+            if (copy_to_user(buf + total * sizeof(struct irqts_clock_sync),
+                        &record, sizeof(record)) != 0)
+            {
+                status = -EFAULT;
+                break;
+            }
+            reader->position++;
+            total++;
+            continue;
+        }
+        if (total > 0 || (file->f_flags & O_NONBLOCK))
+        {
+            break;
+        }
+        if (wait_event_interruptible(sync_wait,
+                    READ_ONCE(sync_head) != reader->position) < 0)
+        {
+            status = -ERESTARTSYS;
+            break;
+        }
+    }
+    mutex_unlock(&reader->lock);
+
+    if (total > 0)
+    {
+        return total * sizeof(struct irqts_clock_sync);
+    }
+    return status < 0 ? status : -EAGAIN;
+}
+
+/**
+ * Invoked when /dev/{CLASS_NAME}/clock_sync is polled
+ */
+static __poll_t sync_dev_poll(struct file* file, poll_table* wait)
+{
+    struct sync_reader* reader = file->private_data;
+
+    poll_wait(file, &sync_wait, wait);
+    return READ_ONCE(sync_head) != READ_ONCE(reader->position)
+            ? EPOLLIN | EPOLLRDNORM : 0;
+}
+
+static const struct file_operations sync_dev_fops = {
+    .owner          = THIS_MODULE,
+    .open           = sync_dev_open,
+    .release        = sync_dev_release,
+    .read           = sync_dev_read,
+    .poll           = sync_dev_poll,
+    .llseek         = no_llseek
+};
+
+/**
+ * Invoked when /dev/{CLASS_NAME}/gpio{GPIO_ID} is opened.
+ */
+static int gpio_dev_open(struct inode* inode, struct file* file)
+{
+    struct gpio_data* gpioData;
+
+    rcu_read_lock();
+    gpioData = xa_load(&gpio_minors, iminor(inode));
+    if (gpioData == NULL || !kref_get_unless_zero(&gpioData->refcount))
+    {
+        rcu_read_unlock();
+        return -ENODEV;
+    }
+    rcu_read_unlock();
+
+    mutex_lock(&gpioData->configLock);
+    gpioData->openCount++;
+    mutex_unlock(&gpioData->configLock);
+
+    file->private_data = gpioData;
+    return nonseekable_open(inode, file);
+}
+
+/**
+ * Invoked when the last reference to an open gpio device file is closed.
+ */
+static int gpio_dev_release(struct inode* inode, struct file* file)
+{
+    struct gpio_data* gpioData = file->private_data;
+
+    mutex_lock(&gpioData->configLock);
+    gpioData->openCount--;
+    mutex_unlock(&gpioData->configLock);
+    kref_put(&gpioData->refcount, release_gpio_data);
+    return 0;
+}
+
+/*
+ * Writes value to out as LEB128 varint, 7 bits per byte starting with the
+ * least significant ones. Returns the number of bytes written.
+ */
+static inline size_t put_varint(u8* out, u64 value)
+{
+    size_t size = 0;
+
+    while (value >= 0x80)
+    {
+        out[size++] = (u8) value | 0x80;
+        value >>= 7;
+    }
+    out[size++] = (u8) value;
+    return size;
+}
+
+/*
+ * Copies up to max of the oldest unread timings of an IRQTS_FORMAT_NS ring
+ * to buf as one packed record, see struct irqts_packed_header. buf must have
+ * room for the header and max varints. Must be called with readLock held.
+ */
+static ssize_t read_packed(struct gpio_data* gpioData, char __user* buf,
+        size_t max)
+{
+    struct irqts_packed_header header = { .gpio = gpioData->gpio };
+    size_t written = sizeof(header);
+    size_t packed = 0;
+    u64 previous = 0;
+    u64 timing;
+    u64 value;
+    u64* entries = gpioData->readBuf;
+    size_t count;
+    size_t i;
+    u32 tail;
+
+    while (header.count < max && ring_count(&gpioData->ring) > 0)
+    {
+        count = read_timings(gpioData, min_t(size_t, max - header.count,
+                    gpioData->config.batchSize));
+        // the entries read end right before the new tail
+        tail = gpioData->ring.header->tail;
+        for (i = 0; i < count; i++)
+        {
+            timing = IRQTS_TIMING64(entries[i]);
+            if (entries[i] == IRQTS_DROP64 || timing == IRQTS_MODE64)
+            {
+                gpioData->packGap = true;
+                continue;
+            }
+            if (header.count == 0)
+            {
+                header.start = timing;
+                header.seq = tail - count + i;
+                previous = timing;
+            }
+            // deltas stay exact across drops, the timestamps are absolute
+            value = min_t(u64, timing > previous ? timing - previous : 0,
+                    U64_MAX >> IRQTS_PACKED_SHIFT) << IRQTS_PACKED_SHIFT;
+            value |= (entries[i] & IRQTS_LEVEL64) ? IRQTS_PACKED_LEVEL : 0;
+            value |= gpioData->packGap ? IRQTS_PACKED_GAP : 0;
+            gpioData->packGap = false;
+            previous = timing;
+            packed += put_varint(gpioData->packBuf + packed, value);
+            header.count++;
+
+            if (packed > PACK_BUF_SIZE - VARINT_MAX_SIZE)
+            {
+                if (copy_to_user(buf + written, gpioData->packBuf, packed) != 0)
+                {
+                    return -EFAULT;
+                }
+                written += packed;
+                packed = 0;
+            }
+        }
+    }
+    if (copy_to_user(buf + written, gpioData->packBuf, packed) != 0)
+    {
+        return -EFAULT;
+    }
+    written += packed;
+
+    if (header.count == 0)
+    {
+        header.seq = gpioData->ring.header->tail;
+    }
+    header.dropped = READ_ONCE(gpioData->ring.header->dropped);
+    header.size = written - sizeof(header);
+    if (copy_to_user(buf, &header, sizeof(header)) != 0)
+    {
+        return -EFAULT;
+    }
+    return written;
+}
+
+/**
+ * Invoked when read from /dev/{CLASS_NAME}/gpio{GPIO_ID}. Copies the oldest
+ * unread timings as raw entries, blocking until watermark timings are unread
+ * unless opened with O_NONBLOCK. Returns 0 once the gpio is unregistered.
+ */
+static ssize_t gpio_dev_read(struct file* file, char __user* buf, size_t size,
+        loff_t* offset)
+{
+    struct gpio_data* gpioData = file->private_data;
+    size_t entrySize = ring_entry_size(&gpioData->ring);
+    bool packed = READ_ONCE(gpioData->config.encoding) == GPIO_ENCODING_PACKED;
+    size_t max = size / entrySize;
+    size_t total = 0;
+    size_t count;
+    ssize_t status;
+    u32 wanted;
+
+    // packed reads return one record with room for the worst case varints
+    if (packed)
+    {
+        max = size < sizeof(struct irqts_packed_header) ? 0
+                : (size - sizeof(struct irqts_packed_header)) / VARINT_MAX_SIZE;
+    }
+    if (max == 0)
+    {
+        return -EINVAL;
+    }
+
+    // wait for enough timings to be unread
+    for (;;)
+    {
+        if (mutex_lock_interruptible(&gpioData->readLock) < 0)
+        {
+            return -ERESTARTSYS;
+        }
+        // the writeback worker consumes the ring alone
+        if (gpioData->wbFile != NULL)
+        {
+            mutex_unlock(&gpioData->readLock);
+            return -EBUSY;
+        }
+        wanted = (file->f_flags & O_NONBLOCK) ? 1
+                : min_t(u32, READ_ONCE(gpioData->config.watermark), max);
+        if (ring_count(&gpioData->ring) >= wanted)
+        {
+            break;
+        }
+        // return a frame ended by an idle gap without waiting for more
+        if (closed_frame_count(gpioData) > 0)
+        {
+            max = min_t(size_t, max, closed_frame_count(gpioData));
+            break;
+        }
+        mutex_unlock(&gpioData->readLock);
+
+        if (READ_ONCE(gpioData->removed))
+        {
+            return 0;
+        }
+        if (file->f_flags & O_NONBLOCK)
+        {
+            return -EAGAIN;
+        }
+        if (wait_event_interruptible(gpioData->readWait,
+                    gpio_readable(gpioData)) < 0)
+        {
+            return -ERESTARTSYS;
+        }
+    }
+
+    if (packed && gpioData->config.encoding == GPIO_ENCODING_PACKED)
+    {
+        status = read_packed(gpioData, buf, max);
+        mutex_unlock(&gpioData->readLock);
+        return status;
+    }
+
+    // copy timings to userspace through the read buffer
+    while (total < max && ring_count(&gpioData->ring) > 0)
+    {
+        count = read_timings(gpioData,
+                min_t(size_t, max - total, gpioData->config.batchSize));
+        if (copy_to_user(buf + total * entrySize, gpioData->readBuf,
+                    count * entrySize) != 0)
+        {
+            mutex_unlock(&gpioData->readLock);
+            return -EFAULT;
+        }
+        total += count;
+    }
+    mutex_unlock(&gpioData->readLock);
+
+    return total * entrySize;
+}
+
+/**
+ * Invoked when /dev/{CLASS_NAME}/gpio{GPIO_ID} is polled. Readable once
+ * watermark timings are unread.
+ */
+static __poll_t gpio_dev_poll(struct file* file, poll_table* wait)
+{
+    struct gpio_data* gpioData = file->private_data;
+
+    poll_wait(file, &gpioData->readWait, wait);
+    if (READ_ONCE(gpioData->removed))
+    {
+        return EPOLLHUP | EPOLLERR;
+    }
+    if (gpio_readable(gpioData))
+    {
+        return EPOLLIN | EPOLLRDNORM;
+    }
+    return 0;
+}
+
+/**
+ * Invoked on ioctl of /dev/{CLASS_NAME}/gpio{GPIO_ID}.
+ */
+static long gpio_dev_ioctl(struct file* file, unsigned int cmd,
+        unsigned long arg)
+{
+    struct gpio_data* gpioData = file->private_data;
+    struct irqts_ring_header* header = gpioData->ring.header;
+    u32 position;
+
+    switch (cmd)
+    {
+    case IRQTS_IOC_CONSUME:
+        // mmap consumers hand back timings they are done with
+        if (get_user(position, (__u32 __user*) arg) != 0)
+        {
+            return -EFAULT;
+        }
+        if (mutex_lock_interruptible(&gpioData->readLock) < 0)
+        {
+            return -ERESTARTSYS;
+        }
+        if (gpioData->wbFile != NULL)
+        {
+            mutex_unlock(&gpioData->readLock);
+            return -EBUSY;
+        }
+        if (position - header->tail
+                > smp_load_acquire(&header->head) - header->tail)
+        {
+            mutex_unlock(&gpioData->readLock);
+            return -EINVAL;
+        }
+        trace_irqts_consume(gpioData->gpio, position - header->tail,
+                position);
+        smp_store_release(&header->tail, position);
+        mutex_unlock(&gpioData->readLock);
+        return 0;
+    default:
+        return -ENOTTY;
+    }
+}
+
+/**
+ * Invoked when /dev/{CLASS_NAME}/gpio{GPIO_ID} is mmap'ed. Maps the ring
+ * header and timings read-only, the mapping keeps the gpio data alive through
+ * its reference on the file.
+ */
+static int gpio_dev_mmap(struct file* file, struct vm_area_struct* vma)
+{
+    struct gpio_data* gpioData = file->private_data;
+
+    if (vma->vm_flags & VM_WRITE)
+    {
+        return -EPERM;
+    }
+    vma->vm_flags &= ~VM_MAYWRITE;
+
+    return remap_vmalloc_range(vma, gpioData->ring.header, vma->vm_pgoff);
+}
+
+/* file operations of the gpio character devices */
+static const struct file_operations gpio_dev_fops = {
+    .owner          = THIS_MODULE,
+    .open           = gpio_dev_open,
+    .release        = gpio_dev_release,
+    .read           = gpio_dev_read,
+    .poll           = gpio_dev_poll,
+    .unlocked_ioctl = gpio_dev_ioctl,
+    .compat_ioctl   = compat_ptr_ioctl,
+    .mmap           = gpio_dev_mmap,
+    .llseek         = no_llseek
+};
+
+/*
+ * Returns 0 if config is a consistent set of capture settings.
+ */
+static int validate_gpio_config(const struct gpio_config* config)
+{
+    if (config->capacity < 2 || config->capacity > MAX_RING_SIZE
+            || !is_power_of_2(config->capacity)
+            || config->batchSize == 0 || config->batchSize > config->capacity
+            || config->watermark == 0 || config->watermark > config->capacity
+            || config->decodeBits > MAX_DECODE_BITS
+            || config->minPulse > MAX_MIN_PULSE
+            // the glitch filter and decoders pair rising and falling edges
+            || (config->edge != IRQTS_EDGE_BOTH
+                && (config->minPulse > 0
+                    || config->decoder != GPIO_DECODER_NONE))
+            || (config->idleTimeout > 0
+                && config->idleTimeout <= config->minPulse)
+            || (config->encoding == GPIO_ENCODING_PACKED
+                && config->format != IRQTS_FORMAT_NS)
+            || config->cpu < -1 || config->cpu >= (int) nr_cpu_ids
+            || config->priority >= MAX_RT_PRIO
+            || (config->triggerMax > 0
+                && config->triggerMax < config->triggerMin)
+            || config->preTrigger > MAX_TRIGGER_EDGES
+            || config->postTrigger > MAX_TRIGGER_EDGES
+            || config->group > IRQTS_GROUPS
+            || (config->stormRate > 0 && config->stormRate < MIN_STORM_RATE)
+            || (config->samplePeriod > 0
+                && (config->samplePeriod < MIN_SAMPLE_PERIOD
+                    || config->samplePeriod > STORM_HOLDOFF))
+            || (config->timestamp == GPIO_TIMESTAMP_HTE
+                && software_only_config(config))
+            || config->pulseStats > 1)
+    {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+/*
+ * Sets up filtering of pulses shorter than minPulse ns, by the debounce of
+ * the gpio controller where supported, and by the irq thread otherwise.
+ * Sets *hwDebounce if the gpio controller filters them.
+ */
+static int setup_glitch_filter(struct gpio_data* gpioData, u32 minPulse,
+        bool* hwDebounce)
+{
+    struct gpio_desc* desc = gpioData->desc;
+
+    *hwDebounce = minPulse > 0 && gpiod_set_debounce(desc,
+            DIV_ROUND_UP(minPulse, NSEC_PER_USEC)) == 0;
+    if (minPulse > 0 && !*hwDebounce && gpioData->tsSource->kick == NULL)
+    {
+        return -EOPNOTSUPP;
+    }
+    if (!*hwDebounce && gpioData->hwDebounce)
+    {
+        gpiod_set_debounce(desc, 0);
+    }
+    return 0;
+}
+
+/*
+ * Allocates the pre-trigger history and the snapshot for the trigger
+ * windows of config.
+ */
+static int trigger_alloc(const struct gpio_config* config, u64** history,
+        struct trigger_snapshot** snapshot)
+{
+    *history = kmalloc_array(config->preTrigger, sizeof(u64), GFP_KERNEL);
+    *snapshot = kzalloc(struct_size(*snapshot, entries,
+                config->preTrigger + 1 + config->postTrigger), GFP_KERNEL);
+    if (*history == NULL || *snapshot == NULL)
+    {
+        kfree(*history);
+        kfree(*snapshot);
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+/*
+ * Re-arms the trigger of a gpio, dropping its snapshot. Must be called with
+ * snapshotLock held, and for new trigger windows with the irq thread
+ * stopped.
+ */
+static void trigger_rearm(struct gpio_data* gpioData)
+{
+    gpioData->historyIndex = 0;
+    gpioData->historyCount = 0;
+    gpioData->triggerHasEdge = false;
+    // pairs with the acquire of the irq thread
+    smp_store_release(&gpioData->triggerState, TRIGGER_ARMED);
+}
+
+/*
+ * Applies new capture settings to a registered gpio. The ring is replaced,
+ * dropping unread timings, when its format or capacity changes. That fails
+ * with -EBUSY while the gpio device is open, since readers and mappings may
+ * still use the old ring. Must be called with configLock held.
+ */
+static int reconfigure_gpio(struct gpio_data* gpioData,
+        const struct gpio_config* config)
+{
+    struct timings_ring ring = { 0 };
+    void* readBuf = NULL;
+    u64* history = NULL;
+    struct trigger_snapshot* snapshot = NULL;
+    bool replaceRing = config->format != gpioData->config.format
+            || config->capacity != gpioData->config.capacity;
+    bool resizeTrigger = config->preTrigger != gpioData->config.preTrigger
+            || config->postTrigger != gpioData->config.postTrigger;
+    bool retrigger = resizeTrigger
+            || config->triggerMin != gpioData->config.triggerMin
+            || config->triggerMax != gpioData->config.triggerMax;
+    bool hwDebounce = gpioData->hwDebounce;
+    bool paused;
+    int status;
+
+    status = validate_gpio_config(config);
+    if (status < 0)
+    {
+        return status;
+    }
+    if (config->timestamp != gpioData->config.timestamp
+            || config->edge != gpioData->config.edge
+            || config->clock != gpioData->config.clock
+            || config->group != gpioData->config.group)
+    {
+        return -EINVAL;
+    }
+    // the injector stages edges without pausing for the reconfiguration
+    if (bench_injecting(gpioData))
+    {
+        return -EBUSY;
+    }
+    if (replaceRing)
+    {
+        if (gpioData->openCount > 0)
+        {
+            return -EBUSY;
+        }
+        status = ring_alloc(&ring, config);
+        if (status < 0)
+        {
+            return status;
+        }
+    }
+    if (config->batchSize != gpioData->config.batchSize)
+    {
+        readBuf = kmalloc_array(config->batchSize, MAX_ENTRY_SIZE,
+                GFP_KERNEL);
+        if (readBuf == NULL)
+        {
+            ring_free(&ring);
+            return -ENOMEM;
+        }
+    }
+    if (resizeTrigger && trigger_alloc(config, &history, &snapshot) < 0)
+    {
+        ring_free(&ring);
+        kfree(readBuf);
+        return -ENOMEM;
+    }
+    if (config->cpu != gpioData->config.cpu)
+    {
+        status = gpioData->tsSource->set_affinity == NULL ? -EOPNOTSUPP
+                : gpioData->tsSource->set_affinity(gpioData, config->cpu);
+        if (status < 0)
+        {
+            ring_free(&ring);
+            kfree(readBuf);
+            kfree(history);
+            kfree(snapshot);
+            return status;
+        }
+    }
+    if (config->minPulse != gpioData->config.minPulse)
+    {
+        status = setup_glitch_filter(gpioData, config->minPulse, &hwDebounce);
+        if (status < 0)
+        {
+            if (config->cpu != gpioData->config.cpu)
+            {
+                gpioData->tsSource->set_affinity(gpioData,
+                        gpioData->config.cpu);
+            }
+            ring_free(&ring);
+            kfree(readBuf);
+            kfree(history);
+            kfree(snapshot);
+            return status;
+        }
+    }
+
+    // apply settings with the irq handlers and readers stopped
+    mutex_lock(&gpioData->readLock);
+    paused = pause_timestamp_source(gpioData);
+    if (replaceRing)
+    {
+        swap(gpioData->ring, ring);
+        gpioData->stagingTail = gpioData->stagingHead;
+        gpioData->glitchPending = false;
+        gpioData->ringDropPending = false;
+        gpioData->ringGeneration = atomic_inc_return(&ring_generation);
+        gpioData->lastInterruptTime = source_now(gpioData->tsSource,
+                gpioData);
+    }
+    if (readBuf != NULL)
+    {
+        swap(gpioData->readBuf, readBuf);
+    }
+    if (retrigger)
+    {
+        mutex_lock(&gpioData->snapshotLock);
+        if (resizeTrigger)
+        {
+            swap(gpioData->history, history);
+            swap(gpioData->snapshot, snapshot);
+        }
+        trigger_rearm(gpioData);
+        mutex_unlock(&gpioData->snapshotLock);
+    }
+    if (config->decoder != gpioData->config.decoder)
+    {
+        // drop frames of the previous decoder
+        gpioData->frameTail = gpioData->frameHead;
+    }
+    gpioData->decoder.state = DECODE_IDLE;
+    gpioData->pulseHasEdge = false;
+    if (config->pulseStats && !gpioData->config.pulseStats)
+    {
+        // edges went unaggregated while off, start a new window
+        WRITE_ONCE(gpioData->pulseReset, true);
+    }
+    gpioData->captureStopped = false;
+    gpioData->hwDebounce = hwDebounce;
+    gpioData->config = *config;
+    if (paused)
+    {
+        resume_timestamp_source(gpioData);
+    }
+    mutex_unlock(&gpioData->readLock);
+
+    // let sleeping readers recheck against the new watermark
+    wake_up_interruptible(&gpioData->readWait);
+
+    // free replaced ring and buffers
+    ring_free(&ring);
+    kfree(readBuf);
+    kfree(history);
+    kfree(snapshot);
+    return 0;
+}
+
+/* names of the timestamp sources, indexed by enum gpio_timestamp */
+static const char* const timestamp_names[] = {
+    [GPIO_TIMESTAMP_SOFTWARE]   = "software",
+    [GPIO_TIMESTAMP_HTE]        = "hte",
+    [GPIO_TIMESTAMP_AUTO]       = "auto",
+};
+
+/* names of the captured edges, indexed by enum irqts_edge */
+static const char* const edge_names[] = {
+    [IRQTS_EDGE_BOTH]       = "both",
+    [IRQTS_EDGE_RISING]     = "rising",
+    [IRQTS_EDGE_FALLING]    = "falling",
+};
+
+/* names of the capture clocks, indexed by enum irqts_clock */
+static const char* const clock_names[] = {
+    [IRQTS_CLOCK_MONOTONIC]     = "monotonic",
+    [IRQTS_CLOCK_MONOTONIC_RAW] = "monotonic_raw",
+    [IRQTS_CLOCK_BOOTTIME]      = "boottime",
+    [IRQTS_CLOCK_TAI]           = "tai",
+};
+
+/* names of the capture formats, indexed by enum irqts_format */
+static const char* const format_names[] = {
+    [IRQTS_FORMAT_US_DELTA] = "us_delta",
+    [IRQTS_FORMAT_NS_DELTA] = "ns_delta",
+    [IRQTS_FORMAT_NS]       = "ns",
+};
+
+/* names of the decoders, indexed by enum gpio_decoder */
+static const char* const decoder_names[] = {
+    [GPIO_DECODER_NONE]         = "none",
+    [GPIO_DECODER_NEC]          = "nec",
+    [GPIO_DECODER_RC5]          = "rc5",
+    [GPIO_DECODER_MANCHESTER]   = "manchester",
+};
+
+/* names of the read encodings, indexed by enum gpio_encoding */
+static const char* const encoding_names[] = {
+    [GPIO_ENCODING_RAW]     = "raw",
+    [GPIO_ENCODING_PACKED]  = "packed",
+};
+
+/* names of the overflow policies, indexed by enum gpio_overflow */
+static const char* const overflow_names[] = {
+    [GPIO_OVERFLOW_OVERWRITE]   = "overwrite",
+    [GPIO_OVERFLOW_DROP]        = "drop",
+    [GPIO_OVERFLOW_STOP]        = "stop",
+};
+
+/* Sets config to the capture settings of newly registered gpio pins. */
+static void init_gpio_config(struct gpio_config* config)
+{
+    *config = (struct gpio_config) {
+        .timestamp  = GPIO_TIMESTAMP_AUTO,
+        .edge       = IRQTS_EDGE_BOTH,
+        .clock      = IRQTS_CLOCK_MONOTONIC,
+        .format     = IRQTS_FORMAT_US_DELTA,
+        .capacity   = RING_SIZE,
+        .batchSize  = BUFFER_SIZE,
+        .cpu        = -1,
+    };
+}
+
+/* gpio options, set through register options or gpio device attributes */
+enum gpio_option {
+    GPIO_OPTION_TIMESTAMP,
+    GPIO_OPTION_FORMAT,
+    GPIO_OPTION_CAPACITY,
+    GPIO_OPTION_BATCH_SIZE,
+    GPIO_OPTION_WATERMARK,
+    GPIO_OPTION_DECODER,
+    GPIO_OPTION_DECODE_UNIT,
+    GPIO_OPTION_DECODE_BITS,
+    GPIO_OPTION_MIN_PULSE,
+    GPIO_OPTION_IDLE_TIMEOUT,
+    GPIO_OPTION_ENCODING,
+    GPIO_OPTION_CPU,
+    GPIO_OPTION_PRIORITY,
+    GPIO_OPTION_OVERFLOW,
+    GPIO_OPTION_TRIGGER_MIN,
+    GPIO_OPTION_TRIGGER_MAX,
+    GPIO_OPTION_PRE_TRIGGER,
+    GPIO_OPTION_POST_TRIGGER,
+    GPIO_OPTION_EDGE,
+    GPIO_OPTION_GROUP,
+    GPIO_OPTION_STORM_RATE,
+    GPIO_OPTION_SAMPLE_PERIOD,
+    GPIO_OPTION_CLOCK,
+    GPIO_OPTION_PULSE_STATS,
+};
+
+/* names of the gpio options, indexed by enum gpio_option */
+static const char* const gpio_option_names[] = {
+    [GPIO_OPTION_TIMESTAMP]     = "timestamp",
+    [GPIO_OPTION_FORMAT]        = "format",
+    [GPIO_OPTION_CAPACITY]      = "capacity",
+    [GPIO_OPTION_BATCH_SIZE]    = "batch_size",
+    [GPIO_OPTION_WATERMARK]     = "watermark",
+    [GPIO_OPTION_DECODER]       = "decoder",
+    [GPIO_OPTION_DECODE_UNIT]   = "decode_unit",
+    [GPIO_OPTION_DECODE_BITS]   = "decode_bits",
+    [GPIO_OPTION_MIN_PULSE]     = "min_pulse",
+    [GPIO_OPTION_IDLE_TIMEOUT]  = "idle_timeout",
+    [GPIO_OPTION_ENCODING]      = "encoding",
+    [GPIO_OPTION_CPU]           = "cpu",
+    [GPIO_OPTION_PRIORITY]      = "priority",
+    [GPIO_OPTION_OVERFLOW]      = "overflow",
+    [GPIO_OPTION_TRIGGER_MIN]   = "trigger_min",
+    [GPIO_OPTION_TRIGGER_MAX]   = "trigger_max",
+    [GPIO_OPTION_PRE_TRIGGER]   = "pre_trigger",
+    [GPIO_OPTION_POST_TRIGGER]  = "post_trigger",
+    [GPIO_OPTION_EDGE]          = "edge",
+    [GPIO_OPTION_GROUP]         = "group",
+    [GPIO_OPTION_STORM_RATE]    = "storm_rate",
+    [GPIO_OPTION_SAMPLE_PERIOD] = "sample_period",
+    [GPIO_OPTION_CLOCK]         = "clock",
+    [GPIO_OPTION_PULSE_STATS]   = "pulse_stats_enable",
+};
+
+/*
+ * Parses the value of an option into config. The config as a whole is
+ * checked by validate_gpio_config.
+ */
+static int parse_gpio_option(struct gpio_config* config,
+        enum gpio_option option, const char* value)
+{
+    unsigned int number;
+    int index;
+
+    if (option == GPIO_OPTION_TIMESTAMP)
+    {
+        index = sysfs_match_string(timestamp_names, value);
+        if (index < 0)
+        {
+            return -EINVAL;
+        }
+        config->timestamp = index;
+        return 0;
+    }
+    if (option == GPIO_OPTION_EDGE)
+    {
+        index = sysfs_match_string(edge_names, value);
+        if (index < 0)
+        {
+            return -EINVAL;
+        }
+        config->edge = index;
+        return 0;
+    }
+    if (option == GPIO_OPTION_CLOCK)
+    {
+        index = sysfs_match_string(clock_names, value);
+        if (index < 0)
+        {
+            return -EINVAL;
+        }
+        config->clock = index;
+        return 0;
+    }
+    if (option == GPIO_OPTION_FORMAT)
+    {
+        index = sysfs_match_string(format_names, value);
+        if (index < 0)
+        {
+            return -EINVAL;
+        }
+        config->format = index;
+        return 0;
+    }
+    if (option == GPIO_OPTION_DECODER)
+    {
+        index = sysfs_match_string(decoder_names, value);
+        if (index < 0)
+        {
+            return -EINVAL;
+        }
+        config->decoder = index;
+        return 0;
+    }
+    if (option == GPIO_OPTION_ENCODING)
+    {
+        index = sysfs_match_string(encoding_names, value);
+        if (index < 0)
+        {
+            return -EINVAL;
+        }
+        config->encoding = index;
+        return 0;
+    }
+    if (option == GPIO_OPTION_OVERFLOW)
+    {
+        index = sysfs_match_string(overflow_names, value);
+        if (index < 0)
+        {
+            return -EINVAL;
+        }
+        config->overflow = index;
+        return 0;
+    }
+    if (option == GPIO_OPTION_CPU && sysfs_streq(value, "none"))
+    {
+        config->cpu = -1;
+        return 0;
+    }
+
+    if (kstrtouint(value, 0, &number) < 0)
+    {
+        return -EINVAL;
+    }
+    switch (option)
+    {
+    case GPIO_OPTION_CAPACITY:
+        if (number == 0 || number > MAX_RING_SIZE)
+        {
+            return -EINVAL;
+        }
+        config->capacity = roundup_pow_of_two(number);
+        return 0;
+    case GPIO_OPTION_BATCH_SIZE:
+        config->batchSize = number;
+        return 0;
+    case GPIO_OPTION_WATERMARK:
+        config->watermark = number;
+        return 0;
+    case GPIO_OPTION_DECODE_UNIT:
+        config->decodeUnit = number;
+        return 0;
+    case GPIO_OPTION_DECODE_BITS:
+        config->decodeBits = number;
+        return 0;
+    case GPIO_OPTION_MIN_PULSE:
+        config->minPulse = number;
+        return 0;
+    case GPIO_OPTION_IDLE_TIMEOUT:
+        config->idleTimeout = number;
+        return 0;
+    case GPIO_OPTION_CPU:
+        if (number > INT_MAX)
+        {
+            return -EINVAL;
+        }
+        config->cpu = number;
+        return 0;
+    case GPIO_OPTION_PRIORITY:
+        config->priority = number;
+        return 0;
+    case GPIO_OPTION_TRIGGER_MIN:
+        config->triggerMin = number;
+        return 0;
+    case GPIO_OPTION_TRIGGER_MAX:
+        config->triggerMax = number;
+        return 0;
+    case GPIO_OPTION_PRE_TRIGGER:
+        config->preTrigger = number;
+        return 0;
+    case GPIO_OPTION_POST_TRIGGER:
+        config->postTrigger = number;
+        return 0;
+    case GPIO_OPTION_GROUP:
+        config->group = number;
+        return 0;
+    case GPIO_OPTION_STORM_RATE:
+        config->stormRate = number;
+        return 0;
+    case GPIO_OPTION_SAMPLE_PERIOD:
+        config->samplePeriod = number;
+        return 0;
+    case GPIO_OPTION_PULSE_STATS:
+        config->pulseStats = number;
+        return 0;
+    default:
+        return -EINVAL;
+    }
+}
+
+/*
+ * Parses whitespace separated "name=value" options into config.
+ */
+static int parse_gpio_options(struct gpio_config* config, char* options)
+{
+    char* option;
+    char* value;
+    int index;
+    int status;
+
+    while ((option = strsep(&options, " \t\n")) != NULL)
+    {
+        if (*option == '\0')
+        {
+            continue;
+        }
+        value = strchr(option, '=');
+        if (value == NULL)
+        {
+            printk(KERN_WARNING "irq_timings: option %s has no value\n",
+                    option);
+            return -EINVAL;
+        }
+        *value++ = '\0';
+        index = match_string(gpio_option_names,
+                ARRAY_SIZE(gpio_option_names), option);
+        if (index < 0)
+        {
+            printk(KERN_WARNING "irq_timings: unknown option %s\n", option);
+            return -EINVAL;
+        }
+        status = parse_gpio_option(config, index, value);
+        if (status < 0)
+        {
+            printk(KERN_WARNING "irq_timings: invalid %s %s\n", option,
+                    value);
+            return status;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Lists all names into buf, with the current one in brackets.
+ */
+static ssize_t show_choices(const char* const* names, size_t count,
+        size_t current, char* buf)
+{
+    size_t written = 0;
+    size_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        written += scnprintf(buf + written, PAGE_SIZE - written,
+                i == current ? "[%s] " : "%s ", names[i]);
+    }
+    buf[written - 1] = '\n';
+    return written;
+}
+
+/*
+ * Formats the value of an option of config into buf.
+ */
+static ssize_t show_gpio_option(const struct gpio_config* config,
+        enum gpio_option option, char* buf)
+{
+    switch (option)
+    {
+    case GPIO_OPTION_TIMESTAMP:
+        return sprintf(buf, "%s\n", timestamp_names[config->timestamp]);
+    case GPIO_OPTION_EDGE:
+        return sprintf(buf, "%s\n", edge_names[config->edge]);
+    case GPIO_OPTION_CLOCK:
+        return sprintf(buf, "%s\n", clock_names[config->clock]);
+    case GPIO_OPTION_FORMAT:
+        return show_choices(format_names, ARRAY_SIZE(format_names),
+                config->format, buf);
+    case GPIO_OPTION_DECODER:
+        return show_choices(decoder_names, ARRAY_SIZE(decoder_names),
+                config->decoder, buf);
+    case GPIO_OPTION_ENCODING:
+        return show_choices(encoding_names, ARRAY_SIZE(encoding_names),
+                config->encoding, buf);
+    case GPIO_OPTION_OVERFLOW:
+        return show_choices(overflow_names, ARRAY_SIZE(overflow_names),
+                config->overflow, buf);
+    case GPIO_OPTION_DECODE_UNIT:
+        return sprintf(buf, "%u\n", config->decodeUnit);
+    case GPIO_OPTION_DECODE_BITS:
+        return sprintf(buf, "%u\n", config->decodeBits);
+    case GPIO_OPTION_MIN_PULSE:
+        return sprintf(buf, "%u\n", config->minPulse);
+    case GPIO_OPTION_IDLE_TIMEOUT:
+        return sprintf(buf, "%u\n", config->idleTimeout);
+    case GPIO_OPTION_CPU:
+        if (config->cpu < 0)
+        {
+            return sprintf(buf, "none\n");
+        }
+        return sprintf(buf, "%d\n", config->cpu);
+    case GPIO_OPTION_PRIORITY:
+        return sprintf(buf, "%u\n", config->priority);
+    case GPIO_OPTION_TRIGGER_MIN:
+        return sprintf(buf, "%u\n", config->triggerMin);
+    case GPIO_OPTION_TRIGGER_MAX:
+        return sprintf(buf, "%u\n", config->triggerMax);
+    case GPIO_OPTION_PRE_TRIGGER:
+        return sprintf(buf, "%u\n", config->preTrigger);
+    case GPIO_OPTION_POST_TRIGGER:
+        return sprintf(buf, "%u\n", config->postTrigger);
+    case GPIO_OPTION_GROUP:
+        return sprintf(buf, "%u\n", config->group);
+    case GPIO_OPTION_STORM_RATE:
+        return sprintf(buf, "%u\n", config->stormRate);
+    case GPIO_OPTION_SAMPLE_PERIOD:
+        return sprintf(buf, "%u\n", config->samplePeriod);
+    case GPIO_OPTION_PULSE_STATS:
+        return sprintf(buf, "%u\n", config->pulseStats);
+    case GPIO_OPTION_CAPACITY:
+        return sprintf(buf, "%u\n", config->capacity);
+    case GPIO_OPTION_BATCH_SIZE:
+        return sprintf(buf, "%u\n", config->batchSize);
+    case GPIO_OPTION_WATERMARK:
+        return sprintf(buf, "%u\n", config->watermark);
+    default:
+        return -EINVAL;
+    }
+}
+
+/**
+ * Invoked when read from /sys/class/{CLASS_NAME}/pin{GPIO_ID}/{OPTION}
+ */
+static ssize_t gpio_option_show(struct device* dev, enum gpio_option option,
+        char* buf)
+{
+    struct gpio_data* gpioData = dev_get_drvdata(dev);
+    ssize_t status;
+
+    mutex_lock(&gpioData->configLock);
+    status = show_gpio_option(&gpioData->config, option, buf);
+    mutex_unlock(&gpioData->configLock);
+
+    return status;
+}
+
+/**
+ * Invoked when write to /sys/class/{CLASS_NAME}/pin{GPIO_ID}/{OPTION}
+ */
+static ssize_t gpio_option_store(struct device* dev, enum gpio_option option,
+        const char* buf, size_t count)
+{
+    struct gpio_data* gpioData = dev_get_drvdata(dev);
+    struct gpio_config config;
+    int status;
+
+    mutex_lock(&gpioData->configLock);
+    config = gpioData->config;
+    status = parse_gpio_option(&config, option, buf);
+    if (status == 0)
+    {
+        status = reconfigure_gpio(gpioData, &config);
+    }
+    mutex_unlock(&gpioData->configLock);
+
+    return status < 0 ? status : count;
+}
+
+/**
+ * Invoked when read from /sys/class/{CLASS_NAME}/pin{GPIO_ID}/stats
+ */
+static ssize_t stats_show(struct device* dev, struct device_attribute* attr,
+        char* buf)
+{
+    struct gpio_data* gpioData = dev_get_drvdata(dev);
+
+    return sprintf(buf, "captured %lu\n"
+            "dropped %lu\n"
+            "overwritten %lu\n"
+            "gaps %lu\n"
+            "wakeups %lu\n"
+            "max_depth %u\n"
+            "frames %lu\n"
+            "frames_dropped %lu\n"
+            "glitches %lu\n"
+            "idle_frames %lu\n"
+            "rejected %lu\n"
+            "triggers %lu\n"
+            "storms %lu\n"
+            "writeback_errors %lu\n",
+            READ_ONCE(gpioData->edgesCaptured),
+            READ_ONCE(gpioData->stagingOverruns),
+            READ_ONCE(gpioData->edgesOverwritten),
+            READ_ONCE(gpioData->readerGaps),
+            READ_ONCE(gpioData->readerWakeups),
+            READ_ONCE(gpioData->maxDepth),
+            READ_ONCE(gpioData->framesDecoded),
+            READ_ONCE(gpioData->framesDropped),
+            READ_ONCE(gpioData->glitchesFiltered),
+            READ_ONCE(gpioData->idleFrames),
+            READ_ONCE(gpioData->edgesRejected),
+            READ_ONCE(gpioData->triggersFired),
+            READ_ONCE(gpioData->storms),
+            READ_ONCE(gpioData->wbErrors));
+}
+
+/**
+ * Invoked when read from /sys/class/{CLASS_NAME}/pin{GPIO_ID}/frames
+ */
+static ssize_t frames_show(struct device* dev, struct device_attribute* attr,
+        char* buf)
+{
+    struct gpio_data* gpioData = dev_get_drvdata(dev);
+    const char* name;
+    struct decoded_frame* frame;
+    unsigned int written = 0;
+    u32 head;
+    u32 tail;
+
+    // consume the oldest decoded frames, one per line
+    if (mutex_lock_interruptible(&gpioData->readLock) < 0)
+    {
+        return -ERESTARTSYS;
+    }
+    name = decoder_names[gpioData->config.decoder];
+    head = smp_load_acquire(&gpioData->frameHead);
+    for (tail = gpioData->frameTail; tail != head; tail++)
+    {
+        // a line is at most 64 bytes
+        if (written + 64 > PAGE_SIZE)
+        {
+            break;
+        }
+        frame = &gpioData->frames[tail & (FRAME_FIFO_SIZE - 1)];
+        written += scnprintf(buf + written, PAGE_SIZE - written,
+                "%s %u 0x%llx %llu\n", name, frame->bits, frame->data,
+                frame->timestamp);
+    }
+    // release frame slots only after they were read
+    smp_store_release(&gpioData->frameTail, tail);
+    mutex_unlock(&gpioData->readLock);
+
+    return written;
+}
+
+/**
+ * Invoked when read from /sys/class/{CLASS_NAME}/pin{GPIO_ID}/snapshot.
+ * Returns the snapshot once frozen, and nothing before.
+ */
+static ssize_t snapshot_read(struct file* file, struct kobject* kobj,
+        struct bin_attribute* attr, char* buf, loff_t offset, size_t count)
+{
+    struct gpio_data* gpioData = dev_get_drvdata(kobj_to_dev(kobj));
+    struct trigger_snapshot* snapshot;
+    ssize_t status = 0;
+
+    mutex_lock(&gpioData->snapshotLock);
+    // pairs with the release of the irq thread on freezing
+    if (smp_load_acquire(&gpioData->triggerState) == TRIGGER_FROZEN)
+    {
+        snapshot = gpioData->snapshot;
+        status = memory_read_from_buffer(buf, count, &offset, snapshot,
+                struct_size(snapshot, entries, snapshot->header.count));
+    }
+    mutex_unlock(&gpioData->snapshotLock);
+
+    return status;
+}
+
+/**
+ * Invoked when write to /sys/class/{CLASS_NAME}/pin{GPIO_ID}/snapshot.
+ * Drops the snapshot and re-arms the trigger.
+ */
+static ssize_t snapshot_write(struct file* file, struct kobject* kobj,
+        struct bin_attribute* attr, char* buf, loff_t offset, size_t count)
+{
+    struct gpio_data* gpioData = dev_get_drvdata(kobj_to_dev(kobj));
+
+    mutex_lock(&gpioData->snapshotLock);
+    // the irq thread only writes the snapshot once it is armed again
+    if (smp_load_acquire(&gpioData->triggerState) == TRIGGER_FROZEN)
+    {
+        smp_store_release(&gpioData->triggerState, TRIGGER_ARMED);
+    }
+    mutex_unlock(&gpioData->snapshotLock);
+
+    return count;
+}
+
+/*
+ * Returns the sample variance of count widths from their 128-bit sum of
+ * squared deviations, saturated at U64_MAX.
+ */
+static u64 pulse_variance(const struct pulse_stats* stats, u64 count)
+{
+    u64 high = stats->m2[1];
+    u64 low = stats->m2[0];
+    unsigned int shift;
+
+    if (count < 2)
+    {
+        return 0;
+    }
+    if (high == 0)
+    {
+        return div64_u64(low, count - 1);
+    }
+    if (high >= count - 1)
+    {
+        return U64_MAX;
+    }
+    // divide the top 64 bits of m2, the quotient still fits as high is lower
+    shift = fls64(high);
+    if (shift < 64)
+    {
+        high = (high << (64 - shift)) | (low >> shift);
+    }
+    return div64_u64(high, count - 1) << shift;
+}
+
+/**
+ * Invoked when read from /sys/class/{CLASS_NAME}/pin{GPIO_ID}/pulse_stats
+ */
+static ssize_t pulse_stats_read(struct file* file, struct kobject* kobj,
+        struct bin_attribute* attr, char* buf, loff_t offset, size_t count)
+{
+    struct gpio_data* gpioData = dev_get_drvdata(kobj_to_dev(kobj));
+    struct irqts_pulse_stats record;
+    struct pulse_stats stats;
+    unsigned int seq;
+
+    if (!READ_ONCE(gpioData->config.pulseStats))
+    {
+        return -ENODATA;
+    }
+    do
+    {
+        seq = read_seqcount_begin(&gpioData->pulseSeq);
+        stats = gpioData->pulseStats;
+    } while (read_seqcount_retry(&gpioData->pulseSeq, seq));
+
+    // a pending reset already hides the previous window
+    record = stats.record;
+    if (READ_ONCE(gpioData->pulseReset))
+    {
+        memset(&record, 0, sizeof(record));
+        stats.mean = 0;
+    }
+    record.edge = gpioData->config.edge;
+    record.mean = (u64) stats.mean >> PULSE_MEAN_SHIFT;
+    record.variance = pulse_variance(&stats, record.count);
+    record.duty = record.high + record.low > 0
+            ? mul_u64_u64_div_u64(record.high, 1000000,
+                    record.high + record.low) : 0;
+
+    return memory_read_from_buffer(buf, count, &offset, &record,
+            sizeof(record));
+}
+
+/**
+ * Invoked when write to /sys/class/{CLASS_NAME}/pin{GPIO_ID}/pulse_stats.
+ * Starts a new statistics window.
+ */
+static ssize_t pulse_stats_write(struct file* file, struct kobject* kobj,
+        struct bin_attribute* attr, char* buf, loff_t offset, size_t count)
+{
+    struct gpio_data* gpioData = dev_get_drvdata(kobj_to_dev(kobj));
+
+    WRITE_ONCE(gpioData->pulseReset, true);
+
+    return count;
+}
+
+/*
+ * Writes the first length bytes of the writeback buffer of a gpio to its
+ * file and keeps the rest. Must be called with wbLock held.
+ */
+static void writeback_write(struct gpio_data* gpioData, size_t length)
+{
+    ssize_t written;
+
+    written = kernel_write(gpioData->wbFile, gpioData->wbBuf, length,
+            &gpioData->wbPos);
+    if (written != length)
+    {
+        // the timings of a failed write are lost
+        printk_ratelimited(KERN_ERR "irq_timings: error writing back gpio%u timings (%zd)\n",
+                gpioData->gpio, written);
+        gpioData->wbErrors++;
+        written = length;
+    }
+    memmove(gpioData->wbBuf, gpioData->wbBuf + written,
+            gpioData->wbUsed - written);
+    gpioData->wbUsed -= written;
+}
+
+/*
+ * Moves unread timings of a gpio into its writeback buffer and writes it
+ * whenever full. Writes the partial buffer as well if flush is set. Must be
+ * called with wbLock held.
+ */
+static void writeback_drain(struct gpio_data* gpioData, bool flush)
+{
+    unsigned int shift = gpioData->ring.entryShift;
+    bool dropped;
+    size_t count;
+
+    do
+    {
+        mutex_lock(&gpioData->readLock);
+        count = ring_read(&gpioData->ring, gpioData->wbBuf + gpioData->wbUsed,
+                (WRITEBACK_SIZE - gpioData->wbUsed) >> shift, &dropped);
+        if (dropped)
+        {
+            gpioData->readerGaps++;
+        }
+        trace_irqts_consume(gpioData->gpio, count,
+                gpioData->ring.header->tail);
+        mutex_unlock(&gpioData->readLock);
+
+        gpioData->wbUsed += count << shift;
+        if (gpioData->wbUsed == WRITEBACK_SIZE)
+        {
+            writeback_write(gpioData, WRITEBACK_SIZE);
+        }
+    } while (count > 0);
+
+    if (flush && gpioData->wbUsed > 0)
+    {
+        writeback_write(gpioData, gpioData->wbUsed);
+    }
+}
+
+/*
+ * Writeback worker of a gpio, queued by the irq thread.
+ */
+static void writeback_work(struct work_struct* work)
+{
+    struct gpio_data* gpioData = container_of(work, struct gpio_data,
+            wbWork);
+
+    mutex_lock(&gpioData->wbLock);
+    if (gpioData->wbFile != NULL)
+    {
+        writeback_drain(gpioData, false);
+    }
+    mutex_unlock(&gpioData->wbLock);
+}
+
+/*
+ * Writes the remaining timings of a gpio back and closes its writeback
+ * file. Must be called with configLock held.
+ */
+static void writeback_stop(struct gpio_data* gpioData)
+{
+    struct file* file;
+
+    mutex_lock(&gpioData->wbLock);
+    file = gpioData->wbFile;
+    if (file == NULL)
+    {
+        mutex_unlock(&gpioData->wbLock);
+        return;
+    }
+    writeback_drain(gpioData, true);
+    WRITE_ONCE(gpioData->wbFile, NULL);
+    mutex_unlock(&gpioData->wbLock);
+
+    // the worker returns right away once the file is gone
+    cancel_work_sync(&gpioData->wbWork);
+    vfs_fsync(file, 0);
+    filp_close(file, NULL);
+    kfree(gpioData->wbPath);
+    gpioData->wbPath = NULL;
+    vfree(gpioData->wbBuf);
+    gpioData->wbBuf = NULL;
+    gpioData->openCount--;
+}
+
+/*
+ * Starts writing the timings of a gpio back to the file at path, truncating
+ * it. Like an open device, writeback keeps the format and capacity fixed.
+ * While it runs, the worker is the only consumer of the ring. Must be called
+ * with configLock held.
+ */
+static int writeback_start(struct gpio_data* gpioData, const char* path)
+{
+    struct irqts_file_header* header;
+    struct file* file;
+    int status = -ENOMEM;
+
+    writeback_stop(gpioData);
+    gpioData->wbBuf = vmalloc(WRITEBACK_SIZE);
+    gpioData->wbPath = kstrdup(path, GFP_KERNEL);
+    if (gpioData->wbBuf == NULL || gpioData->wbPath == NULL)
+    {
+        goto WritebackError;
+    }
+    file = filp_open(path, O_WRONLY | O_CREAT | O_TRUNC | O_LARGEFILE,
+            0644);
+    if (IS_ERR(file))
+    {
+        printk(KERN_ERR "irq_timings: error opening %s for gpio%u writeback\n",
+                path, gpioData->gpio);
+        status = PTR_ERR(file);
+        goto WritebackError;
+    }
+
+    // the file starts with a header describing its entries
+    header = gpioData->wbBuf;
+    memset(header, 0, sizeof(struct irqts_file_header));
+    header->magic = IRQTS_FILE_MAGIC;
+    header->version = IRQTS_FILE_VERSION;
+    header->header_size = sizeof(struct irqts_file_header);
+    header->gpio = gpioData->gpio;
+    header->format = gpioData->config.format;
+    header->entry_size = ring_entry_size(&gpioData->ring);
+    header->edge = gpioData->config.edge;
+    header->clock = gpioData->config.clock;
+    if (gpioData->tsSource != NULL && gpioData->tsSource->now == NULL)
+    {
+        header->flags |= IRQTS_FILE_HARDWARE;
+    }
+
+    gpioData->openCount++;
+    gpioData->wbUsed = sizeof(struct irqts_file_header);
+    gpioData->wbPos = 0;
+    // readers check for writeback under readLock before consuming
+    mutex_lock(&gpioData->wbLock);
+    mutex_lock(&gpioData->readLock);
+    WRITE_ONCE(gpioData->wbFile, file);
+    mutex_unlock(&gpioData->readLock);
+    mutex_unlock(&gpioData->wbLock);
+    // the unread timings are written back first
+    queue_work(system_unbound_wq, &gpioData->wbWork);
+    return 0;
+
+WritebackError:
+    kfree(gpioData->wbPath);
+    vfree(gpioData->wbBuf);
+    gpioData->wbPath = NULL;
+    gpioData->wbBuf = NULL;
+    return status;
+}
+
+/**
+ * Invoked when read from /sys/class/{CLASS_NAME}/pin{GPIO_ID}/writeback
+ */
+static ssize_t writeback_show(struct device* dev,
+        struct device_attribute* attr, char* buf)
+{
+    struct gpio_data* gpioData = dev_get_drvdata(dev);
+    ssize_t status;
+
+    mutex_lock(&gpioData->configLock);
+    status = sprintf(buf, "%s\n", gpioData->wbPath != NULL
+            ? gpioData->wbPath : "");
+    mutex_unlock(&gpioData->configLock);
+
+    return status;
+}
+
+/**
+ * Invoked when write to /sys/class/{CLASS_NAME}/pin{GPIO_ID}/writeback.
+ * Starts writeback to the given file, or stops it for an empty line.
+ */
+static ssize_t writeback_store(struct device* dev,
+        struct device_attribute* attr, const char* buf, size_t count)
+{
+    struct gpio_data* gpioData = dev_get_drvdata(dev);
+    char* path;
+    int status = 0;
+
+    path = kstrndup(buf, count, GFP_KERNEL);
+    if (path == NULL)
+    {
+        return -ENOMEM;
+    }
+    mutex_lock(&gpioData->configLock);
+    if (*strim(path) == '\0')
+    {
+        writeback_stop(gpioData);
+    }
+    else
+    {
+        status = writeback_start(gpioData, strim(path));
+    }
+    mutex_unlock(&gpioData->configLock);
+    kfree(path);
+
+    return status < 0 ? status : count;
+}
+
+#define GPIO_OPTION_ATTR(_name, _option) \
+    static ssize_t _name##_show(struct device* dev, \
+            struct device_attribute* attr, char* buf) \
+    { \
+        return gpio_option_show(dev, _option, buf); \
+    } \
+    static ssize_t _name##_store(struct device* dev, \
+            struct device_attribute* attr, const char* buf, size_t count) \
+    { \
+        return gpio_option_store(dev, _option, buf, count); \
+    } \
+    static DEVICE_ATTR(_name, PERM_RW, _name##_show, _name##_store)
+
+/**
+ * Invoked when read from /sys/class/{CLASS_NAME}/pin{GPIO_ID}/timestamp
+ */
+static ssize_t timestamp_show(struct device* dev,
+        struct device_attribute* attr, char* buf)
+{
+    return gpio_option_show(dev, GPIO_OPTION_TIMESTAMP, buf);
+}
+
+/**
+ * Invoked when read from /sys/class/{CLASS_NAME}/pin{GPIO_ID}/edge
+ */
+static ssize_t edge_show(struct device* dev, struct device_attribute* attr,
+        char* buf)
+{
+    return gpio_option_show(dev, GPIO_OPTION_EDGE, buf);
+}
+
+/**
+ * Invoked when read from /sys/class/{CLASS_NAME}/pin{GPIO_ID}/clock
+ */
+static ssize_t clock_show(struct device* dev, struct device_attribute* attr,
+        char* buf)
+{
+    return gpio_option_show(dev, GPIO_OPTION_CLOCK, buf);
+}
+
+/**
+ * Invoked when read from /sys/class/{CLASS_NAME}/pin{GPIO_ID}/group
+ */
+static ssize_t group_show(struct device* dev, struct device_attribute* attr,
+        char* buf)
+{
+    return gpio_option_show(dev, GPIO_OPTION_GROUP, buf);
+}
 
-#define CLASS_ATTR_WRITE(_name) \
-    struct class_attribute class_attr_##_name = __ATTR(_name, PERM_WO, \
-                                                       NULL, _name##_store)
-/* struct representing driver_class. defined below */
-static struct class driver_class;
+/* gpio device sysfs attributes */
+static DEVICE_ATTR(timestamp, PERM_RO, timestamp_show, NULL); // dev_attr_timestamp
+static DEVICE_ATTR(edge, PERM_RO, edge_show, NULL); // dev_attr_edge
+static DEVICE_ATTR(clock, PERM_RO, clock_show, NULL); // dev_attr_clock
+static DEVICE_ATTR(group, PERM_RO, group_show, NULL); // dev_attr_group
+GPIO_OPTION_ATTR(format, GPIO_OPTION_FORMAT); // dev_attr_format
+GPIO_OPTION_ATTR(capacity, GPIO_OPTION_CAPACITY); // dev_attr_capacity
+GPIO_OPTION_ATTR(batch_size, GPIO_OPTION_BATCH_SIZE); // dev_attr_batch_size
+GPIO_OPTION_ATTR(watermark, GPIO_OPTION_WATERMARK); // dev_attr_watermark
+GPIO_OPTION_ATTR(decoder, GPIO_OPTION_DECODER); // dev_attr_decoder
+GPIO_OPTION_ATTR(decode_unit, GPIO_OPTION_DECODE_UNIT); // dev_attr_decode_unit
+GPIO_OPTION_ATTR(decode_bits, GPIO_OPTION_DECODE_BITS); // dev_attr_decode_bits
+GPIO_OPTION_ATTR(min_pulse, GPIO_OPTION_MIN_PULSE); // dev_attr_min_pulse
+GPIO_OPTION_ATTR(idle_timeout, GPIO_OPTION_IDLE_TIMEOUT); // dev_attr_idle_timeout
+GPIO_OPTION_ATTR(encoding, GPIO_OPTION_ENCODING); // dev_attr_encoding
+GPIO_OPTION_ATTR(cpu, GPIO_OPTION_CPU); // dev_attr_cpu
+GPIO_OPTION_ATTR(priority, GPIO_OPTION_PRIORITY); // dev_attr_priority
+GPIO_OPTION_ATTR(overflow, GPIO_OPTION_OVERFLOW); // dev_attr_overflow
+GPIO_OPTION_ATTR(trigger_min, GPIO_OPTION_TRIGGER_MIN); // dev_attr_trigger_min
+GPIO_OPTION_ATTR(trigger_max, GPIO_OPTION_TRIGGER_MAX); // dev_attr_trigger_max
+GPIO_OPTION_ATTR(pre_trigger, GPIO_OPTION_PRE_TRIGGER); // dev_attr_pre_trigger
+GPIO_OPTION_ATTR(post_trigger, GPIO_OPTION_POST_TRIGGER); // dev_attr_post_trigger
+GPIO_OPTION_ATTR(storm_rate, GPIO_OPTION_STORM_RATE); // dev_attr_storm_rate
+GPIO_OPTION_ATTR(sample_period, GPIO_OPTION_SAMPLE_PERIOD); // dev_attr_sample_period
+GPIO_OPTION_ATTR(pulse_stats_enable, GPIO_OPTION_PULSE_STATS); // dev_attr_pulse_stats_enable
+static DEVICE_ATTR(frames, PERM_RO, frames_show, NULL); // dev_attr_frames
+static DEVICE_ATTR(stats, PERM_RO, stats_show, NULL); // dev_attr_stats
+static DEVICE_ATTR(writeback, PERM_RW, writeback_show, writeback_store); // dev_attr_writeback
 
-/* struct representing node in ReadQueue */
-static struct TimingsNode {
-    unsigned int* timings;
-    struct TimingsNode* next;
+/* list all gpio device attributes in attributes group */
+static struct attribute* gpio_dev_attrs[] = {
+    &dev_attr_timestamp.attr,
+    &dev_attr_edge.attr,
+    &dev_attr_clock.attr,
+    &dev_attr_group.attr,
+    &dev_attr_format.attr,
+    &dev_attr_capacity.attr,
+    &dev_attr_batch_size.attr,
+    &dev_attr_watermark.attr,
+    &dev_attr_stats.attr,
+    &dev_attr_writeback.attr,
+    &dev_attr_decoder.attr,
+    &dev_attr_decode_unit.attr,
+    &dev_attr_decode_bits.attr,
+    &dev_attr_frames.attr,
+    &dev_attr_min_pulse.attr,
+    &dev_attr_idle_timeout.attr,
+    &dev_attr_encoding.attr,
+    &dev_attr_cpu.attr,
+    &dev_attr_priority.attr,
+    &dev_attr_overflow.attr,
+    &dev_attr_trigger_min.attr,
+    &dev_attr_trigger_max.attr,
+    &dev_attr_pre_trigger.attr,
+    &dev_attr_post_trigger.attr,
+    &dev_attr_storm_rate.attr,
+    &dev_attr_sample_period.attr,
+    &dev_attr_pulse_stats_enable.attr,
+    NULL
 };
 
-/* struct representing gpio data */
-static struct gpio_data {
-    struct class_attribute class_attr_gpio;
-    unsigned int irq_number;
-    unsigned int* writeBuf;
-    size_t writeI;
-    ktime_t lastInterruptTime;
-    
-    // read queue
-    struct TimingsNode* readQueue_head;
-    struct TimingsNode* readQueue_tail;
-    size_t readQueueSize;
-    struct mutex readQueueLock;
-} *registered_gpios[GPIO_COUNT];
+/* binary gpio device sysfs attributes */
+static struct bin_attribute bin_attr_snapshot = // bin_attr_snapshot
+        __BIN_ATTR(snapshot, PERM_RW, snapshot_read, snapshot_write, 0);
+static struct bin_attribute bin_attr_pulse_stats = // bin_attr_pulse_stats
+        __BIN_ATTR(pulse_stats, PERM_RW, pulse_stats_read, pulse_stats_write,
+                sizeof(struct irqts_pulse_stats));
+
+static struct bin_attribute* gpio_dev_bin_attrs[] = {
+    &bin_attr_snapshot,
+    &bin_attr_pulse_stats,
+    NULL
+};
 
-static void free_gpio_data(size_t gpio)
+/* Hides the pin attributes on the merged device, which has no gpio data. */
+static umode_t gpio_dev_attr_visible(struct kobject* kobj,
+        struct attribute* attr, int n)
 {
-    struct TimingsNode *currentTimingsNode, *nextTimingsNode;
-    
-    if (registered_gpios[gpio] != NULL)
+    if (dev_get_drvdata(kobj_to_dev(kobj)) == NULL)
     {
-        // Delete everything from read queue
-        currentTimingsNode = registered_gpios[gpio]->readQueue_head;
-        while (currentTimingsNode != NULL)
-        {
-            nextTimingsNode = currentTimingsNode->next;
-            kfree(currentTimingsNode->timings);
-            kfree(currentTimingsNode);
-            currentTimingsNode = nextTimingsNode;
-        }
-
-        kfree(registered_gpios[gpio]->writeBuf);
-        kfree(registered_gpios[gpio]->class_attr_gpio.attr.name);
-        kfree(registered_gpios[gpio]);
-        registered_gpios[gpio] = NULL;
+        return 0;
     }
+    return attr->mode;
 }
 
-static irq_handler_t gpio_irq_handler(unsigned int irq, void* data,
-        struct pt_regs* regs)
+static umode_t gpio_dev_bin_attr_visible(struct kobject* kobj,
+        struct bin_attribute* attr, int n)
 {
-    ktime_t timeNow = ktime_get();
-    struct gpio_data* gpio_data = (struct gpio_data*) data;
-    struct TimingsNode* timingsNode;
-    //printk(KERN_INFO "irq_timings: gpio_irq_handler called (irq:%u)\n", irq);
-    
-    gpio_data->writeBuf[gpio_data->writeI] = ktime_us_delta(timeNow,
-            gpio_data->lastInterruptTime);
-    gpio_data->lastInterruptTime = timeNow;
-    // if write buffer filled, move to read queue and allocate new write buf
-    if (++gpio_data->writeI >= BUFFER_SIZE)
-    {
-        // create new read queue entry
-        timingsNode = kmalloc(sizeof(struct TimingsNode), GFP_KERNEL);
-        timingsNode->timings = gpio_data->writeBuf;
-        timingsNode->next = NULL;
-        // create new write buf
-        gpio_data->writeBuf = kmalloc(BUFFER_SIZE * sizeof(unsigned int),
-                GFP_KERNEL);
-        gpio_data->writeI = 0;
-        // add read queue entry to read queue
-        if (mutex_lock_interruptible(&gpio_data->readQueueLock) < 0)
-        {
-            // TODO no restart?
-            kfree(timingsNode->timings);
-            kfree(timingsNode);
-
-            return (irq_handler_t) IRQ_HANDLED;
-        }
-        if (gpio_data->readQueue_head == NULL)
-        {
-            gpio_data->readQueue_head = timingsNode;
-            gpio_data->readQueue_tail = timingsNode;
-        }
-        else
-        {
-            gpio_data->readQueue_tail->next = timingsNode;
-            gpio_data->readQueue_tail = timingsNode;
-        }
-        // remove head of queue if queue is full
-        if (++gpio_data->readQueueSize > MAX_READ_QUEUE_SIZE)
-        {
-            timingsNode = gpio_data->readQueue_head->next;
-            kfree(gpio_data->readQueue_head->timings);
-            kfree(gpio_data->readQueue_head);
-            gpio_data->readQueue_head = timingsNode;
-            gpio_data->readQueueSize--;
-        }
-        mutex_unlock(&gpio_data->readQueueLock);
+    if (dev_get_drvdata(kobj_to_dev(kobj)) == NULL)
+    {
+        return 0;
     }
-    return (irq_handler_t) IRQ_HANDLED;
+    return attr->attr.mode;
 }
 
-/**
- * Invoked when read from /sys/class/{CLASS_NAME}/gpio{GPIO_ID}
+static const struct attribute_group gpio_dev_group = {
+    .attrs          = gpio_dev_attrs,
+    .bin_attrs      = gpio_dev_bin_attrs,
+    .is_visible     = gpio_dev_attr_visible,
+    .is_bin_visible = gpio_dev_bin_attr_visible,
+};
+
+static const struct attribute_group* gpio_dev_groups[] = {
+    &gpio_dev_group,
+    NULL
+};
+
+/*
+ * Sets up capture on a gpio line claimed by the caller, as a child of
+ * parent, or NULL for lines registered through sysfs. The line is released
+ * by unregister_gpio, but left to the caller on failure. Must be called with
+ * registry_lock held.
  */
-static ssize_t gpio_show(struct class* class, struct class_attribute* class_attr,
-        char* buf)
+static int register_gpio(struct gpio_desc* desc, struct gpio_config* config,
+        struct device* parent)
 {
-    char gpio_id_chararr[sizeof(GPIO_COUNT)];
-    unsigned long gpio;
-    struct TimingsNode* timingsNode;
-    size_t bufI;
-    unsigned int written = 0;
+    unsigned int gpio = desc_to_gpio(desc);
+    struct gpio_data* gpioData;
+    char* class_attr_name;
+    struct device* device;
     int status;
 
-    // get gpio id
-    snprintf(gpio_id_chararr, sizeof(GPIO_COUNT), "%s",
-            (class_attr->attr.name + (sizeof(GPIO_ATTR_PREFIX) - 1)));
-    if (kstrtoul(gpio_id_chararr, 10, &gpio) < 0)
+    if (config->watermark == 0)
     {
-        printk(KERN_ERR "irq_timings: failed to retrieve gpio id\n");
-        return -1;
+        config->watermark = min(config->batchSize, config->capacity);
     }
-    
-    if (registered_gpios[gpio] == NULL)
+    if (validate_gpio_config(config) < 0)
     {
-        printk(KERN_ERR "irq_timings: failed to retrieve gpio data\n");
-        return -1;
+        printk(KERN_WARNING "invalid options for gpio %u\n", gpio);
+        return -EINVAL;
     }
 
-    // retrieve the first timings from the queue
-    if (mutex_lock_interruptible(&registered_gpios[gpio]->readQueueLock) < 0)
+    // verify gpio is not already registered
+    if (xa_load(&registered_gpios, gpio) != NULL)
     {
-        return -ERESTARTSYS;
+        printk(KERN_ERR "gpio %u is already registered\n", gpio);
+        return -EBUSY;
     }
-    if (registered_gpios[gpio]->readQueue_head == NULL)
+
+    // set gpio pin as input
+    status = gpiod_direction_input(desc);
+    if (status < 0)
     {
-        mutex_unlock(&registered_gpios[gpio]->readQueueLock);
-        return 0;
+        printk(KERN_ERR "error setting gpio %u as input\n", gpio);
+        return status;
     }
-    timingsNode = registered_gpios[gpio]->readQueue_head;
-    if (registered_gpios[gpio]->readQueue_tail == timingsNode)
+
+    // create struct gpio_data obj for this gpio pin
+    gpioData = kmem_cache_zalloc(gpio_data_cache, GFP_KERNEL);
+    if (gpioData == NULL)
     {
-        registered_gpios[gpio]->readQueue_head = NULL;
-        registered_gpios[gpio]->readQueue_tail = NULL;
+        return -ENOMEM;
     }
-    else
+    kref_init(&gpioData->refcount);
+    gpioData->gpio = gpio;
+    gpioData->desc = desc;
+    gpioData->parent = parent;
+    class_attr_name = kasprintf(GFP_KERNEL, "%s%u", GPIO_ATTR_PREFIX, gpio);
+    gpioData->config = *config;
+    gpioData->readBuf = kmalloc_array(config->batchSize, MAX_ENTRY_SIZE,
+            GFP_KERNEL);
+    gpioData->ringGeneration = atomic_inc_return(&ring_generation);
+    status = -ENOMEM;
+    if (class_attr_name == NULL || gpioData->readBuf == NULL
+            || trigger_alloc(config, &gpioData->history,
+                    &gpioData->snapshot) < 0
+            || ring_alloc(&gpioData->ring, config) < 0
+            || xa_insert(&registered_gpios, gpio, gpioData, GFP_KERNEL) < 0)
+    {
+        printk(KERN_ERR "error allocating gpio %u buffers\n", gpio);
+        kfree(class_attr_name);
+        goto GpioClassAttributeFileError;
+    }
+    gpioData->class_attr_gpio.attr = (struct attribute) { class_attr_name,
+                                    VERIFY_OCTAL_PERMISSIONS(PERM_RO) };
+    gpioData->class_attr_gpio.show = gpio_show;
+    gpioData->class_attr_gpio.store = NULL;
+    mutex_init(&gpioData->readLock);
+    mutex_init(&gpioData->configLock);
+    mutex_init(&gpioData->snapshotLock);
+    mutex_init(&gpioData->wbLock);
+    INIT_WORK(&gpioData->wbWork, writeback_work);
+    seqcount_init(&gpioData->pulseSeq);
+    init_waitqueue_head(&gpioData->readWait);
+    hrtimer_init(&gpioData->glitchTimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    gpioData->glitchTimer.function = glitch_timer_expired;
+    hrtimer_init(&gpioData->idleTimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    gpioData->idleTimer.function = idle_timer_expired;
+    hrtimer_init(&gpioData->stormTimer, CLOCK_MONOTONIC,
+            HRTIMER_MODE_ABS_HARD);
+    gpioData->stormTimer.function = storm_timer_expired;
+    bench_init_gpio(gpioData);
+
+    // add gpio class attribute file
+    status = class_create_file(&driver_class, &gpioData->class_attr_gpio);
+    if (status < 0)
     {
-        registered_gpios[gpio]->readQueue_head = timingsNode->next;
+        printk(KERN_ERR "error creating gpio%u class attribute file\n", gpio);
+        goto GpioClassAttributeFileError;
     }
-    registered_gpios[gpio]->readQueueSize--;
-    mutex_unlock(&registered_gpios[gpio]->readQueueLock);
 
-    // generate timings string
-    for (bufI = 0; bufI < BUFFER_SIZE; bufI++)
+    // join capture group before the first edge
+    status = group_join(gpioData);
+    if (status < 0)
     {
-        status = snprintf((buf + written), PAGE_SIZE - written, "%u\n",
-                timingsNode->timings[bufI]);
-        if (status >= 0)
-        {
-            written += status;
-        }
-        else
-        {
-            printk(KERN_ERR "Error reading entire timings buffer\n");
-            break;
-        }
-        if (written == PAGE_SIZE)
-        {
-            printk(KERN_WARNING "Quit reading timing buffer since PAGE_SIZE number\
-                    of bytes were read\n");
-            break;
-        }
+        printk(KERN_ERR "error adding gpio %u to group %u\n", gpio,
+                config->group);
+        goto GpioInterruptSetupError;
     }
 
-    // free timings node
-    kfree(timingsNode->timings);
-    kfree(timingsNode);
+    // setup interrupt or hardware timestamps
+    status = start_timestamp_source(gpioData, config->timestamp);
+    if (status < 0)
+    {
+        printk(KERN_ERR "error setting up %s timestamps on gpio %u\n",
+                timestamp_names[config->timestamp], gpio);
+        goto GpioGroupError;
+    }
+    status = setup_glitch_filter(gpioData, config->minPulse,
+            &gpioData->hwDebounce);
+    if (status < 0)
+    {
+        printk(KERN_ERR "error setting up glitch filter on gpio %u\n", gpio);
+        goto GpioCharDeviceError;
+    }
 
-    return written;
+    // add gpio character device
+    status = xa_alloc(&gpio_minors, &gpioData->minor, gpioData,
+            XA_LIMIT(0, MAX_GPIO_DEVICES - 1), GFP_KERNEL);
+    if (status < 0)
+    {
+        printk(KERN_ERR "error allocating gpio%u device number\n", gpio);
+        goto GpioCharDeviceError;
+    }
+    gpioData->cdev = cdev_alloc();
+    if (gpioData->cdev == NULL)
+    {
+        printk(KERN_ERR "error allocating gpio%u character device\n", gpio);
+        status = -ENOMEM;
+        goto GpioCharDeviceError;
+    }
+    gpioData->cdev->owner = THIS_MODULE;
+    gpioData->cdev->ops = &gpio_dev_fops;
+    status = cdev_add(gpioData->cdev,
+            MKDEV(MAJOR(driver_devt), gpioData->minor), 1);
+    if (status < 0)
+    {
+        printk(KERN_ERR "error adding gpio%u character device\n", gpio);
+        kobject_put(&gpioData->cdev->kobj);
+        goto GpioCharDeviceError;
+    }
+    device = device_create(&driver_class, parent, gpioData->cdev->dev,
+            gpioData, "%s%u", GPIO_DEV_PREFIX, gpio);
+    if (IS_ERR(device))
+    {
+        printk(KERN_ERR "error creating gpio%u device\n", gpio);
+        status = PTR_ERR(device);
+        goto GpioDeviceError;
+    }
+    WRITE_ONCE(gpioData->device, device);
+    return 0;
+
+    /* handler cleanup after error */
+GpioDeviceError:
+    cdev_del(gpioData->cdev);
+GpioCharDeviceError:
+    stop_timestamp_source(gpioData);
+GpioGroupError:
+    group_leave(gpioData);
+GpioInterruptSetupError:
+    class_remove_file(&driver_class, &gpioData->class_attr_gpio);
+GpioClassAttributeFileError:
+    free_gpio_data(gpioData);
+    return status;
 }
 
 /**
@@ -227,92 +5251,102 @@ static ssize_t register_store(struct class* class,
         struct class_attribute* attr, const char* buf, size_t count)
 {
     unsigned long gpio;
-    struct gpio_data* gpioData;
-    char* class_attr_name;
+    struct gpio_config config;
+    char* input;
+    char* options;
+    int status;
     printk(KERN_INFO "irq_timings: register store called\n");
 
-    // read gpio pin from input
-    if (kstrtoul(buf, 0, &gpio) < 0)
+    init_gpio_config(&config);
+
+    // read gpio pin and options from input, "PIN [name=value ...]"
+    input = kstrndup(buf, count, GFP_KERNEL);
+    if (input == NULL)
+    {
+        return -ENOMEM;
+    }
+    options = strim(input);
+    status = kstrtoul(strsep(&options, " \t"), 0, &gpio);
+    if (status == 0 && options != NULL)
+    {
+        status = parse_gpio_options(&config, options);
+    }
+    kfree(input);
+    if (status < 0)
     {
         printk(KERN_WARNING "error parsing input\n");
         return -EINVAL;
     }
     
-    // verify gpio is within GPIO_COUNT
-    if (gpio >= GPIO_COUNT)
+    // verify gpio is a valid gpio number
+    if (gpio > INT_MAX || !gpio_is_valid(gpio))
     {
         printk(KERN_ERR "gpio %lu is outside acceptable range\n", gpio);
         return -EINVAL;
     }
 
-    // verify gpio is not already registered
-    if (registered_gpios[gpio] != NULL)
-    {
-        printk(KERN_ERR "gpio %lu is already registered\n", gpio);
-        return -1;
-    }
+    mutex_lock(&registry_lock);
 
     // allocate gpio pin
-    if (gpio_request(gpio, "gpio-"+gpio) < 0)
+    if (gpio_request(gpio, CLASS_NAME) < 0)
     {
         printk(KERN_ERR "error allocating gpio %lu\n", gpio);
+        mutex_unlock(&registry_lock);
         return -EINVAL;
     }
-
-    // set gpio pin as input
-    if (gpio_direction_input(gpio) < 0)
+    if (register_gpio(gpio_to_desc(gpio), &config, NULL) < 0)
     {
-        printk(KERN_ERR "error setting gpio %lu as input\n", gpio);
-        goto GpioDirectionSetupError;
+        gpio_free(gpio);
+        mutex_unlock(&registry_lock);
+        // return -1 to mark error status
+        return -1;
     }
 
-    // create struct gpio_data obj for this gpio pin
-    gpioData = kmalloc(sizeof(struct gpio_data), GFP_KERNEL);
-    class_attr_name = kmalloc(GPIO_ATTR_NAME_SIZE, GFP_KERNEL);
-    snprintf(class_attr_name, GPIO_ATTR_NAME_SIZE, "%s%lu",
-            GPIO_ATTR_PREFIX, gpio);
-    gpioData->class_attr_gpio.attr = (struct attribute) { class_attr_name,
-                                    VERIFY_OCTAL_PERMISSIONS(PERM_RO) };
-    gpioData->class_attr_gpio.show = gpio_show;
-    gpioData->class_attr_gpio.store = NULL;
-    gpioData->writeBuf = kmalloc(BUFFER_SIZE * sizeof(unsigned int), GFP_KERNEL);
-    gpioData->writeI = 0;
-    gpioData->lastInterruptTime = ktime_get();
-    gpioData->readQueue_head = NULL;
-    gpioData->readQueue_tail = NULL;
-    gpioData->readQueueSize = 0;
-    mutex_init(&gpioData->readQueueLock);
-    registered_gpios[gpio] = gpioData;
+    mutex_unlock(&registry_lock);
+    return count;
+}
 
-    // add gpio class attribute file
-    if (class_create_file(&driver_class, &registered_gpios[gpio]->class_attr_gpio) < 0)
+/*
+ * Releases the interrupt, files and gpio pin of a registered gpio. Must be
+ * called with registry_lock held.
+ */
+static void unregister_gpio(struct gpio_data* gpioData)
+{
+    // remove gpio interrupt or hardware timestamps
+    mutex_lock(&gpioData->configLock);
+    bench_stop(gpioData);
+    stop_timestamp_source(gpioData);
+    writeback_stop(gpioData);
+    mutex_unlock(&gpioData->configLock);
+    group_leave(gpioData);
+
+    // remove gpio device, open files keep their reference to the gpio data
+    device_destroy(&driver_class, gpioData->cdev->dev);
+    cdev_del(gpioData->cdev);
+
+    // wake up readers, they see the gpio is gone
+    WRITE_ONCE(gpioData->removed, true);
+    wake_up_interruptible_all(&gpioData->readWait);
+
+    // remove gpio class attribute file
+    class_remove_file(&driver_class, &gpioData->class_attr_gpio);
+
+    // free gpio pin, without hardware debounce
+    if (gpioData->hwDebounce)
     {
-        printk(KERN_ERR "error creating gpio%lu class attribute file\n", gpio);
-        goto GpioClassAttributeFileError;
+        gpiod_set_debounce(gpioData->desc, 0);
     }
-
-    // setup interrupt
-    registered_gpios[gpio]->irq_number = gpio_to_irq(gpio);
-    if (request_irq(registered_gpios[gpio]->irq_number,
-                (irq_handler_t) gpio_irq_handler,
-                IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING,
-                class_attr_name, registered_gpios[gpio]) < 0)
+    if (gpioData->parent != NULL)
     {
-        printk(KERN_ERR "error setting up interrupt on gpio %lu\n", gpio);
-        goto GpioInterruptSetupError;
+        gpiod_put(gpioData->desc);
+    }
+    else
+    {
+        gpio_free(gpioData->gpio);
     }
 
-    return count;
-
-    /* handler cleanup after error */
-GpioInterruptSetupError:
-    class_remove_file(&driver_class, &registered_gpios[gpio]->class_attr_gpio);
-GpioClassAttributeFileError:
-    free_gpio_data(gpio);
-GpioDirectionSetupError:
-    gpio_free(gpio);
-    // return -1 to mark error status
-    return -1;
+    // free and remove gpio data from registered_gpios
+    free_gpio_data(gpioData);
 }
 
 /**
@@ -322,6 +5356,7 @@ static ssize_t unregister_store(struct class* class,
         struct class_attribute* attr, const char* buf, size_t count)
 {
     unsigned long gpio;
+    struct gpio_data* gpioData;
     printk(KERN_INFO "irq_timings: unregister store called\n");
 
     // read gpio from input
@@ -331,35 +5366,160 @@ static ssize_t unregister_store(struct class* class,
         return -EINVAL;
     }
 
-    // verify gpio is within GPIO_COUNT
-    if (gpio >= GPIO_COUNT)
-    {
-        printk(KERN_ERR "gpio %lu is outside acceptable range\n", gpio);
-        return -EINVAL;
-    }
+    mutex_lock(&registry_lock);
 
     // verify gpio is currently registered
-    if (registered_gpios[gpio] == NULL)
+    gpioData = xa_load(&registered_gpios, gpio);
+    if (gpioData == NULL)
     {
         printk(KERN_ERR "gpio %lu is not registered\n", gpio);
+        mutex_unlock(&registry_lock);
         return -1;
     }
 
-    // remove gpio interrupt
-    free_irq(registered_gpios[gpio]->irq_number, registered_gpios[gpio]);
+    unregister_gpio(gpioData);
 
-    // remove gpio class attribute file
-    class_remove_file(&driver_class, &registered_gpios[gpio]->class_attr_gpio);
+    mutex_unlock(&registry_lock);
+    return count;
+}
+
+/*
+ * Parses the gpio options given as properties of a firmware node into
+ * config. Property names are the option names with dashes for underscores,
+ * values are strings or numbers.
+ */
+static int parse_fwnode_options(struct gpio_config* config,
+        struct fwnode_handle* fwnode)
+{
+    char name[32];
+    char number[16];
+    const char* value;
+    u32 u32Value;
+    size_t i;
+    int status;
+
+    for (i = 0; i < ARRAY_SIZE(gpio_option_names); i++)
+    {
+        strscpy(name, gpio_option_names[i], sizeof(name));
+        strreplace(name, '_', '-');
+        if (fwnode_property_read_string(fwnode, name, &value) == 0)
+        {
+            status = parse_gpio_option(config, i, value);
+        }
+        else if (fwnode_property_read_u32(fwnode, name, &u32Value) == 0)
+        {
+            snprintf(number, sizeof(number), "%u", u32Value);
+            status = parse_gpio_option(config, i, number);
+        }
+        else
+        {
+            continue;
+        }
+        if (status < 0)
+        {
+            printk(KERN_WARNING "irq_timings: invalid %s of %s\n", name,
+                    fwnode_get_name(fwnode));
+            return status;
+        }
+    }
+    return 0;
+}
 
-    // free gpio pin
-    gpio_free(gpio);
+/*
+ * Unregisters the gpio pins registered by a platform device. Must be called
+ * with registry_lock held.
+ */
+static void unregister_device_gpios(struct device* dev)
+{
+    struct gpio_data* gpioData;
+    unsigned long gpio;
 
-    // free and remove gpio data from registered_gpios
-    free_gpio_data(gpio);
+    xa_for_each(&registered_gpios, gpio, gpioData)
+    {
+        if (gpioData->parent == dev)
+        {
+            unregister_gpio(gpioData);
+        }
+    }
+}
 
-    return count;
+/**
+ * Invoked when a platform device matching irqts_of_match is probed. Each
+ * child node is one gpio line, claimed through its "gpios" property with the
+ * flags given there, and configured by its option properties.
+ */
+static int irqts_probe(struct platform_device* pdev)
+{
+    struct device* dev = &pdev->dev;
+    struct fwnode_handle* child;
+    struct gpio_config config;
+    struct gpio_desc* desc;
+    int status = 0;
+
+    mutex_lock(&registry_lock);
+    device_for_each_child_node(dev, child)
+    {
+        init_gpio_config(&config);
+        status = parse_fwnode_options(&config, child);
+        if (status < 0)
+        {
+            break;
+        }
+        desc = fwnode_gpiod_get_index(child, NULL, 0, GPIOD_IN, CLASS_NAME);
+        if (IS_ERR(desc))
+        {
+            status = PTR_ERR(desc);
+            if (status != -EPROBE_DEFER)
+            {
+                printk(KERN_ERR "irq_timings: error getting gpio of %s\n",
+                        fwnode_get_name(child));
+            }
+            break;
+        }
+        status = register_gpio(desc, &config, dev);
+        if (status < 0)
+        {
+            gpiod_put(desc);
+            break;
+        }
+    }
+    if (status < 0)
+    {
+        fwnode_handle_put(child);
+        unregister_device_gpios(dev);
+    }
+    mutex_unlock(&registry_lock);
+
+    return status;
 }
 
+/**
+ * Invoked when a probed platform device is removed.
+ */
+static int irqts_remove(struct platform_device* pdev)
+{
+    mutex_lock(&registry_lock);
+    unregister_device_gpios(&pdev->dev);
+    mutex_unlock(&registry_lock);
+    return 0;
+}
+
+/* device tree nodes of gpio lines captured from boot */
+static const struct of_device_id irqts_of_match[] = {
+    { .compatible = "enlilodisho,irq-timings" },
+    { }
+};
+MODULE_DEVICE_TABLE(of, irqts_of_match);
+
+static struct platform_driver irqts_driver = {
+    .probe  = irqts_probe,
+    .remove = irqts_remove,
+    .driver = {
+        .name           = CLASS_NAME,
+        .of_match_table = irqts_of_match,
+    },
+};
+
 /* class sysfs attributes */
 static CLASS_ATTR_WRITE(register); // class_attr_register
 static CLASS_ATTR_WRITE(unregister); // class_attr_unregister
@@ -372,11 +5532,33 @@ static struct attribute* irq_timings_class_attrs[] = {
 };
 ATTRIBUTE_GROUPS(irq_timings_class);
 
+/**
+ * Invoked to name the /dev node of a gpio device, /dev/{CLASS_NAME}/gpio{GPIO_ID}
+ */
+static char* driver_class_devnode(struct device* dev, umode_t* mode)
+{
+    struct gpio_data* gpioData = dev_get_drvdata(dev);
+
+    if (mode != NULL)
+    {
+        *mode = PERM_RO;
+    }
+    // the merged, group and clock sync devices have no gpio data
+    if (gpioData == NULL)
+    {
+        return kasprintf(GFP_KERNEL, "%s/%s", CLASS_NAME, dev_name(dev));
+    }
+    return kasprintf(GFP_KERNEL, "%s/%s", CLASS_NAME,
+            gpioData->class_attr_gpio.attr.name);
+}
+
 /* struct representing driver class */
 static struct class driver_class = {
     .name           = CLASS_NAME,
     .owner          = THIS_MODULE,
-    .class_groups   = irq_timings_class_groups
+    .class_groups   = irq_timings_class_groups,
+    .dev_groups     = gpio_dev_groups,
+    .devnode        = driver_class_devnode
 };
 
 
@@ -387,6 +5569,21 @@ static int __init irqts_init(void)
 {
     printk(KERN_INFO "irq_timings: hello\n");
 
+    // allocate device numbers for the gpio character devices
+    if (alloc_chrdev_region(&driver_devt, 0, DEVICE_MINORS, CLASS_NAME) < 0)
+    {
+        printk(KERN_ERR "failure allocating %s device numbers\n", CLASS_NAME);
+        goto ChrdevRegionError;
+    }
+
+    // create cache for gpio data, allocated on register
+    gpio_data_cache = KMEM_CACHE(gpio_data, SLAB_HWCACHE_ALIGN);
+    if (gpio_data_cache == NULL)
+    {
+        printk(KERN_ERR "failure creating %s gpio data cache\n", CLASS_NAME);
+        goto CacheError;
+    }
+
     // create driver class
     if (class_register(&driver_class) < 0)
     {
@@ -394,11 +5591,82 @@ static int __init irqts_init(void)
         goto ClassError;
     }
 
+    // create the merged device of all pins
+    merge_cdev = cdev_alloc();
+    if (merge_cdev == NULL)
+    {
+        printk(KERN_ERR "failure allocating %s cdev\n", MERGE_DEV_NAME);
+        goto MergeCdevError;
+    }
+    merge_cdev->owner = THIS_MODULE;
+    merge_cdev->ops = &merge_dev_fops;
+    if (cdev_add(merge_cdev, MKDEV(MAJOR(driver_devt), MERGE_MINOR), 1) < 0)
+    {
+        printk(KERN_ERR "failure adding %s cdev\n", MERGE_DEV_NAME);
+        kobject_put(&merge_cdev->kobj);
+        goto MergeCdevError;
+    }
+    merge_device = device_create(&driver_class, NULL, merge_cdev->dev, NULL,
+            MERGE_DEV_NAME);
+    if (IS_ERR(merge_device))
+    {
+        printk(KERN_ERR "failure creating %s device\n", MERGE_DEV_NAME);
+        goto MergeDeviceError;
+    }
+    debug_files_init();
+    group_init();
+
+    // create the clock sync device and emit the first record right away
+    sync_cdev = cdev_alloc();
+    if (sync_cdev == NULL)
+    {
+        printk(KERN_ERR "failure allocating %s cdev\n", SYNC_DEV_NAME);
+        goto SyncCdevError;
+    }
+    sync_cdev->owner = THIS_MODULE;
+    sync_cdev->ops = &sync_dev_fops;
+    if (cdev_add(sync_cdev, MKDEV(MAJOR(driver_devt), SYNC_MINOR), 1) < 0)
+    {
+        printk(KERN_ERR "failure adding %s cdev\n", SYNC_DEV_NAME);
+        kobject_put(&sync_cdev->kobj);
+        goto SyncCdevError;
+    }
+    sync_device = device_create(&driver_class, NULL, sync_cdev->dev, NULL,
+            SYNC_DEV_NAME);
+    if (IS_ERR(sync_device))
+    {
+        printk(KERN_ERR "failure creating %s device\n", SYNC_DEV_NAME);
+        goto SyncDeviceError;
+    }
+    schedule_delayed_work(&sync_work, 0);
+
+    // capture the gpio lines described by the device tree
+    if (platform_driver_register(&irqts_driver) < 0)
+    {
+        printk(KERN_ERR "failure registering %s platform driver\n", CLASS_NAME);
+        goto PlatformDriverError;
+    }
+
     return 0;
 
     /* handle cleanup after error */
+PlatformDriverError:
+    cancel_delayed_work_sync(&sync_work);
+    device_destroy(&driver_class, sync_cdev->dev);
+SyncDeviceError:
+    cdev_del(sync_cdev);
+SyncCdevError:
+    debug_files_exit();
+    device_destroy(&driver_class, merge_cdev->dev);
+MergeDeviceError:
+    cdev_del(merge_cdev);
+MergeCdevError:
     class_destroy(&driver_class);
 ClassError:
+    kmem_cache_destroy(gpio_data_cache);
+CacheError:
+    unregister_chrdev_region(driver_devt, DEVICE_MINORS);
+ChrdevRegionError:
     // return -1 to mark error status
     return -1;
 }
@@ -408,19 +5676,26 @@ ClassError:
  */
 static void __exit irqts_exit(void)
 {
-    size_t i;
-    // free all registered gpio
-    for (i = 0; i < GPIO_COUNT; i++)
+    struct gpio_data* gpioData;
+    unsigned long gpio;
+    // free the gpio lines of the device tree, then all other registered gpio
+    platform_driver_unregister(&irqts_driver);
+    mutex_lock(&registry_lock);
+    xa_for_each(&registered_gpios, gpio, gpioData)
     {
-        if (registered_gpios[i] != NULL)
-        {
-            free_irq(registered_gpios[i]->irq_number, registered_gpios[i]);
-            class_remove_file(&driver_class, &registered_gpios[i]->class_attr_gpio);
-            gpio_free(i);
-            free_gpio_data(i);
-        }
+        unregister_gpio(gpioData);
     }
+    mutex_unlock(&registry_lock);
+    group_exit();
+    cancel_delayed_work_sync(&sync_work);
+    device_destroy(&driver_class, sync_cdev->dev);
+    cdev_del(sync_cdev);
+    debug_files_exit();
+    device_destroy(&driver_class, merge_cdev->dev);
+    cdev_del(merge_cdev);
     class_destroy(&driver_class);
+    kmem_cache_destroy(gpio_data_cache);
+    unregister_chrdev_region(driver_devt, DEVICE_MINORS);
     printk(KERN_INFO "irq_timings: exit\n");
 }
 
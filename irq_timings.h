@@ -0,0 +1,309 @@
+/*
+ * irq_timings.h
+ *
+ * Userspace interface of the irq_timings kernel module. Shared between the
+ * kernel module and programs consuming /dev/irq_timings/gpio{GPIO_ID}.
+ *
+ * Enlil Odisho
+ * github@enlilodisho.com
+ * October 2021
+ */
+
+#ifndef _IRQ_TIMINGS_H
+#define _IRQ_TIMINGS_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#define IRQTS_RING_MAGIC    0x49525154  // "IRQT"
+#define IRQTS_RING_VERSION  1
+#define IRQTS_FILE_MAGIC    0x49525446  // "IRTF"
+#define IRQTS_FILE_VERSION  1
+
+/*
+ * Capture formats, selected per gpio pin through
+ * /sys/class/irq_timings/pin{GPIO_ID}/format
+ *
+ * IRQTS_FORMAT_US_DELTA: u32 microseconds since the previous edge (default)
+ * IRQTS_FORMAT_NS_DELTA: u32 nanoseconds since the previous edge
+ * IRQTS_FORMAT_NS:       u64 nanoseconds of the edge on the capture clock
+ *
+ * The top bit of every entry holds the level of the line right after the
+ * edge, so 1 marks a rising edge. For the delta formats the timing in the
+ * remaining bits is the duration of the opposite level. Deltas that do not
+ * fit are saturated to IRQTS_OVERFLOW32.
+ *
+ * Where edges were lost, a single IRQTS_DROP32 or IRQTS_DROP64 entry is
+ * inserted in the stream in place of them. The entry after a drop marker
+ * still holds the time since the last captured edge.
+ */
+enum irqts_format {
+    IRQTS_FORMAT_US_DELTA = 0,
+    IRQTS_FORMAT_NS_DELTA = 1,
+    IRQTS_FORMAT_NS       = 2,
+};
+
+/*
+ * Edges captured, selected per gpio pin when it is registered.
+ *
+ * IRQTS_EDGE_BOTH:    rising and falling edges (default). Delta timings are
+ *                     pulse widths, the duration of the opposite level.
+ * IRQTS_EDGE_RISING:  rising edges only. Delta timings are periods, the level
+ *                     bit is always set.
+ * IRQTS_EDGE_FALLING: falling edges only. Delta timings are periods, the level
+ *                     bit is always clear.
+ */
+enum irqts_edge {
+    IRQTS_EDGE_BOTH    = 0,
+    IRQTS_EDGE_RISING  = 1,
+    IRQTS_EDGE_FALLING = 2,
+};
+
+/*
+ * Capture clocks of the software timestamps, selected per gpio pin when it
+ * is registered. Timestamps of a hardware timestamping engine keep the clock
+ * of the engine.
+ *
+ * IRQTS_CLOCK_MONOTONIC:     CLOCK_MONOTONIC (default), slewed by NTP
+ * IRQTS_CLOCK_MONOTONIC_RAW: CLOCK_MONOTONIC_RAW, the free running hardware
+ *                            clock, never slewed
+ * IRQTS_CLOCK_BOOTTIME:      CLOCK_BOOTTIME, CLOCK_MONOTONIC including suspend
+ * IRQTS_CLOCK_TAI:           CLOCK_TAI, follows the PTP timescale of a PTP
+ *                            hardware clock the system clock is synchronized to
+ */
+enum irqts_clock {
+    IRQTS_CLOCK_MONOTONIC     = 0,
+    IRQTS_CLOCK_MONOTONIC_RAW = 1,
+    IRQTS_CLOCK_BOOTTIME      = 2,
+    IRQTS_CLOCK_TAI           = 3,
+};
+
+#define IRQTS_CLOCKS        4
+
+#define IRQTS_LEVEL32       0x80000000U
+#define IRQTS_LEVEL64       0x8000000000000000ULL
+#define IRQTS_TIMING32(entry)   ((entry) & ~IRQTS_LEVEL32)
+#define IRQTS_TIMING64(entry)   ((entry) & ~IRQTS_LEVEL64)
+
+#define IRQTS_OVERFLOW32    0x7fffffffU // time since previous edge too long
+#define IRQTS_DROP32        0x7ffffffeU // edges lost before the next entry
+#define IRQTS_DROP64        0x7fffffffffffffffULL
+
+/*
+ * Capture mode changes of the interrupt storm guard, see storm_rate. The
+ * timing bits of the entry equal IRQTS_MODE32 or IRQTS_MODE64, its level bit
+ * is set when the line is sampled by a timer from then on, and clear when
+ * edges are captured by interrupts again. Edges may be lost around both.
+ */
+#define IRQTS_MODE32        0x7ffffffdU
+#define IRQTS_MODE64        0x7ffffffffffffffeULL
+
+/*
+ * Header at offset 0 of the mmap'ed timings ring of a gpio pin. The mapping
+ * is read-only, the timing entries start at data_offset.
+ *
+ * head and tail run freely and are masked with (capacity - 1) to get the
+ * entry index. head is the number of timings written by the kernel so far
+ * and is updated with release semantics after the entry is written, so
+ * consumers must read it with acquire semantics before reading entries. tail
+ * is the position of the read()/sysfs consumer. Consumers of the mapping
+ * keep their own position; when head - position exceeds capacity, the
+ * entries at the position have been overwritten. dropped counts edges lost
+ * before reaching the ring, each loss is marked by a drop entry.
+ */
+struct irqts_ring_header {
+    __u32 magic;        // IRQTS_RING_MAGIC
+    __u32 version;      // IRQTS_RING_VERSION
+    __u32 capacity;     // number of entries, power of two
+    __u32 entry_size;   // size of one entry in bytes
+    __u32 data_offset;  // offset of first entry from start of mapping
+    __u32 format;       // enum irqts_format of the entries
+    __u32 dropped;      // edges lost before reaching the ring
+    __u32 frame_end;    // head at the last idle gap, see idle_timeout
+    __u32 edge;         // enum irqts_edge captured
+    __u32 clock;        // enum irqts_clock of the timestamps
+    __u32 reserved[6];
+
+    __u32 head __attribute__((aligned(64)));    // written by kernel capture
+    __u32 tail __attribute__((aligned(64)));    // written by kernel readers
+};
+
+/*
+ * Header at offset 0 of a file written through
+ * /sys/class/irq_timings/pin{GPIO_ID}/writeback. The entries follow at
+ * header_size, as read() returns them in the capture format of the pin.
+ * IRQTS_FILE_HARDWARE is set in flags when the timestamps were taken by a
+ * hardware timestamp engine and are on its clock instead of clock.
+ */
+#define IRQTS_FILE_HARDWARE 0x1
+
+struct irqts_file_header {
+    __u32 magic;        // IRQTS_FILE_MAGIC
+    __u32 version;      // IRQTS_FILE_VERSION
+    __u32 header_size;  // offset of first entry from start of file
+    __u32 gpio;         // gpio number of the pin
+    __u32 format;       // enum irqts_format of the entries
+    __u32 entry_size;   // size of one entry in bytes
+    __u32 edge;         // enum irqts_edge captured
+    __u32 clock;        // enum irqts_clock of the timestamps
+    __u32 flags;        // IRQTS_FILE_* flags
+    __u32 reserved[7];
+};
+
+/*
+ * ioctls of /dev/irq_timings/gpio{GPIO_ID}
+ *
+ * IRQTS_IOC_CONSUME: sets tail to the given position, which must lie between
+ *                    tail and head. Lets consumers of the mapping release
+ *                    timings so poll() waits for the next watermark.
+ */
+#define IRQTS_IOC_MAGIC     'T'
+#define IRQTS_IOC_CONSUME   _IOW(IRQTS_IOC_MAGIC, 1, __u32)
+
+/*
+ * Record read from /dev/irq_timings/gpio{GPIO_ID} with the packed encoding,
+ * selected through /sys/class/irq_timings/pin{GPIO_ID}/encoding for pins in
+ * the IRQTS_FORMAT_NS format. Each read() returns one header followed by size
+ * bytes holding count LEB128 varints, one per edge. Each varint holds the ns
+ * since the previous edge of the record, 0 for the first edge, shifted left
+ * by IRQTS_PACKED_SHIFT, below it the IRQTS_PACKED_* flags of the edge.
+ */
+struct irqts_packed_header {
+    __u64 start;    // IRQTS_FORMAT_NS timing of the first edge
+    __u32 gpio;
+    __u32 seq;      // ring position of the first edge, runs like head
+    __u32 dropped;  // edges lost before reaching the ring so far
+    __u32 count;    // number of edges
+    __u32 size;     // bytes of varints after the header
+    __u32 reserved;
+};
+
+#define IRQTS_PACKED_LEVEL  0x1 // level of the line after the edge
+#define IRQTS_PACKED_GAP    0x2 // edges were lost right before this one
+#define IRQTS_PACKED_SHIFT  2
+
+/*
+ * Snapshot read from /sys/class/irq_timings/pin{GPIO_ID}/snapshot once a
+ * pulse matched the trigger of the pin. count IRQTS_FORMAT_NS entries follow
+ * the header, pre of them before the edge ending the triggering pulse, then
+ * that edge, then post edges after it. Edges lost in between are marked by
+ * IRQTS_DROP64 entries.
+ */
+struct irqts_snapshot {
+    __u64 trigger;  // IRQTS_FORMAT_NS timing of the trigger edge
+    __u64 width;    // ns of the pulse ended by the trigger edge
+    __u32 pre;
+    __u32 post;
+    __u32 count;    // pre + 1 + post entries
+    __u32 reserved;
+};
+
+/*
+ * Record read from /sys/class/irq_timings/pin{GPIO_ID}/pulse_stats,
+ * aggregating the pulse widths of a pin since it was registered or the file
+ * was last written. The widths are the delta timings of the pin, so periods
+ * for pins capturing a single edge, see enum irqts_edge. Widths spanning lost
+ * edges are left out.
+ *
+ * histogram[i] counts widths of 2^i to 2^(i+1) - 1 ns, the last bucket also
+ * counts longer ones and the first one widths below 2 ns. high and low are the
+ * ns spent at each level, and duty their ratio in parts per million, both
+ * only for pins capturing both edges. The variance saturates at ~0ULL, a
+ * standard deviation of ~4.29 s.
+ */
+#define IRQTS_PULSE_BUCKETS 32
+
+struct irqts_pulse_stats {
+    __u64 start;    // IRQTS_FORMAT_NS timing of the first edge, 0 if none
+    __u64 last;     // IRQTS_FORMAT_NS timing of the last edge
+    __u64 count;    // number of widths
+    __u64 min;      // ns
+    __u64 max;      // ns
+    __u64 mean;     // ns
+    __u64 variance; // ns^2, sample variance
+    __u64 high;     // ns at high level
+    __u64 low;      // ns at low level
+    __u32 edge;     // enum irqts_edge captured
+    __u32 duty;     // high / (high + low) in parts per million
+    __u32 histogram[IRQTS_PULSE_BUCKETS];
+};
+
+/*
+ * Record read from /dev/irq_timings/all, the time-ordered merge of the edges
+ * of all selected gpio pins. Only pins in the IRQTS_FORMAT_NS format are
+ * merged, and of those only the ones with the enum irqts_clock and
+ * timestamp source of the lowest merged gpio.
+ */
+struct irqts_event {
+    __u64 timestamp;    // IRQTS_FORMAT_NS entry, level in the top bit
+    __u32 gpio;
+    __u32 flags;
+};
+
+#define IRQTS_EVENT_DROPPED 0x1 // edges of the pin were lost before this one
+
+/*
+ * Pins merged by /dev/irq_timings/all, bit (gpio % 64) of bits[gpio / 64]
+ * selects a gpio below IRQTS_MASK_GPIOS.
+ */
+#define IRQTS_MASK_GPIOS    1024
+
+struct irqts_pin_mask {
+    __u64 bits[IRQTS_MASK_GPIOS / 64];
+};
+
+/*
+ * ioctls of /dev/irq_timings/all
+ *
+ * IRQTS_IOC_SELECT:     merges only the pins in the given mask.
+ * IRQTS_IOC_SELECT_ALL: merges all registered pins (default).
+ */
+#define IRQTS_IOC_SELECT        _IOW(IRQTS_IOC_MAGIC, 2, struct irqts_pin_mask)
+#define IRQTS_IOC_SELECT_ALL    _IO(IRQTS_IOC_MAGIC, 3)
+
+/*
+ * Capture groups, selected per gpio pin when it is registered. The edges of
+ * all pins of a group share one ring, capture clock and timestamp source,
+ * read in order from /dev/irq_timings/group{GROUP_ID} as struct
+ * irqts_group_event records. A group holds up to IRQTS_GROUP_PINS pins, each in a member slot.
+ */
+#define IRQTS_GROUPS        8   // groups 1 to IRQTS_GROUPS
+#define IRQTS_GROUP_PINS    16
+
+struct irqts_group_event {
+    __u64 timestamp;    // ns, never earlier than the previous event
+    __u32 gpio;         // pin of the edge
+    __u16 levels;       // bit i: level of member slot i after the edge
+    __u8 member;        // member slot of the pin
+    __u8 flags;         // IRQTS_EVENT_DROPPED if events were lost before
+};
+
+/* Member slots of a capture group, gpios[i] is valid if bit i of used is set. */
+struct irqts_group_members {
+    __u32 used;
+    __u32 gpios[IRQTS_GROUP_PINS];
+};
+
+/*
+ * ioctls of /dev/irq_timings/group{GROUP_ID}
+ *
+ * IRQTS_IOC_GROUP_MEMBERS: returns the member slots of the group.
+ */
+#define IRQTS_IOC_GROUP_MEMBERS _IOR(IRQTS_IOC_MAGIC, 4, struct irqts_group_members)
+
+/*
+ * Record read from /dev/irq_timings/clock_sync, pairing the capture clocks
+ * with CLOCK_REALTIME. One record is emitted every second and readers start
+ * at the newest one. All clocks are read between two reads of CLOCK_REALTIME,
+ * realtime is their midpoint and uncertainty the ns between them. A jump of
+ * CLOCK_REALTIME, as set by settimeofday(), shows as a jump of realtime minus
+ * clocks[i] between records.
+ */
+struct irqts_clock_sync {
+    __u64 realtime;     // CLOCK_REALTIME ns
+    __u64 clocks[IRQTS_CLOCKS]; // ns of each enum irqts_clock
+    __u32 uncertainty;  // ns
+    __u32 seq;          // records emitted before this one, gaps were lost
+};
+
+#endif /* _IRQ_TIMINGS_H */
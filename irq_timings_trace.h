@@ -0,0 +1,164 @@
+/*
+ * irq_timings_trace.h
+ *
+ * Tracepoints of the irq_timings kernel module, in the irq_timings trace
+ * system. Disabled tracepoints cost a static branch only, so they are safe
+ * in the capture path.
+ *
+ * Enlil Odisho
+ * github@enlilodisho.com
+ * October 2021
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM irq_timings
+
+#if !defined(_IRQ_TIMINGS_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _IRQ_TIMINGS_TRACE_H
+
+#include <linux/tracepoint.h>
+
+#ifndef _IRQ_TIMINGS_TRACE_DEFS
+#define _IRQ_TIMINGS_TRACE_DEFS
+/* where edges were lost, see irqts_drop */
+enum irqts_drop_reason {
+    IRQTS_DROP_STAGING,     // staging slots full, the irq thread fell behind
+    IRQTS_DROP_REJECTED,    // ring full, rejected by the overflow policy
+    IRQTS_DROP_OVERWRITTEN, // unread timing overwritten in the ring
+};
+#endif
+
+TRACE_DEFINE_ENUM(IRQTS_DROP_STAGING);
+TRACE_DEFINE_ENUM(IRQTS_DROP_REJECTED);
+TRACE_DEFINE_ENUM(IRQTS_DROP_OVERWRITTEN);
+
+/* an edge written to the ring of a pin by the irq thread */
+TRACE_EVENT(irqts_capture,
+
+    TP_PROTO(unsigned int gpio, u64 timestamp, bool level, u32 head),
+
+    TP_ARGS(gpio, timestamp, level, head),
+
+    TP_STRUCT__entry(
+        __field(unsigned int, gpio)
+        __field(u64, timestamp)
+        __field(bool, level)
+        __field(u32, head)
+    ),
+
+    TP_fast_assign(
+        __entry->gpio = gpio;
+        __entry->timestamp = timestamp;
+        __entry->level = level;
+        __entry->head = head;
+    ),
+
+    TP_printk("gpio=%u timestamp=%llu level=%d head=%u", __entry->gpio,
+        __entry->timestamp, __entry->level, __entry->head)
+);
+
+/* a batch of staged edges moved into the ring of a pin by the irq thread */
+TRACE_EVENT(irqts_drain,
+
+    TP_PROTO(unsigned int gpio, u32 edges, u32 head, u32 depth),
+
+    TP_ARGS(gpio, edges, head, depth),
+
+    TP_STRUCT__entry(
+        __field(unsigned int, gpio)
+        __field(u32, edges)
+        __field(u32, head)
+        __field(u32, depth)
+    ),
+
+    TP_fast_assign(
+        __entry->gpio = gpio;
+        __entry->edges = edges;
+        __entry->head = head;
+        __entry->depth = depth;
+    ),
+
+    TP_printk("gpio=%u edges=%u head=%u depth=%u", __entry->gpio,
+        __entry->edges, __entry->head, __entry->depth)
+);
+
+/* edges of a pin lost before or after reaching its ring */
+TRACE_EVENT(irqts_drop,
+
+    TP_PROTO(unsigned int gpio, u32 count, enum irqts_drop_reason reason),
+
+    TP_ARGS(gpio, count, reason),
+
+    TP_STRUCT__entry(
+        __field(unsigned int, gpio)
+        __field(u32, count)
+        __field(int, reason)
+    ),
+
+    TP_fast_assign(
+        __entry->gpio = gpio;
+        __entry->count = count;
+        __entry->reason = reason;
+    ),
+
+    TP_printk("gpio=%u count=%u reason=%s", __entry->gpio, __entry->count,
+        __print_symbolic(__entry->reason,
+            { IRQTS_DROP_STAGING, "staging" },
+            { IRQTS_DROP_REJECTED, "rejected" },
+            { IRQTS_DROP_OVERWRITTEN, "overwritten" }))
+);
+
+/* readers of a pin woken up at their watermark */
+TRACE_EVENT(irqts_wakeup,
+
+    TP_PROTO(unsigned int gpio, u32 head, u32 tail),
+
+    TP_ARGS(gpio, head, tail),
+
+    TP_STRUCT__entry(
+        __field(unsigned int, gpio)
+        __field(u32, head)
+        __field(u32, tail)
+    ),
+
+    TP_fast_assign(
+        __entry->gpio = gpio;
+        __entry->head = head;
+        __entry->tail = tail;
+    ),
+
+    TP_printk("gpio=%u head=%u tail=%u", __entry->gpio, __entry->head,
+        __entry->tail)
+);
+
+/* timings of a pin consumed by a reader, or released by a mmap consumer */
+TRACE_EVENT(irqts_consume,
+
+    TP_PROTO(unsigned int gpio, u32 count, u32 tail),
+
+    TP_ARGS(gpio, count, tail),
+
+    TP_STRUCT__entry(
+        __field(unsigned int, gpio)
+        __field(u32, count)
+        __field(u32, tail)
+    ),
+
+    TP_fast_assign(
+        __entry->gpio = gpio;
+        __entry->count = count;
+        __entry->tail = tail;
+    ),
+
+    TP_printk("gpio=%u count=%u tail=%u", __entry->gpio, __entry->count,
+        __entry->tail)
+);
+
+#endif /* _IRQ_TIMINGS_TRACE_H */
+
+/* the module is built out of tree, its trace header is found through -I$(src) */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE irq_timings_trace
+#include <trace/define_trace.h>
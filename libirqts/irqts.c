@@ -0,0 +1,340 @@
+/*
+ * irqts.c
+ *
+ * Userspace library consuming the timings of the irq_timings kernel module,
+ * see irqts.h.
+ *
+ * Enlil Odisho
+ * github@enlilodisho.com
+ * October 2021
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "irqts.h"
+
+#define CLASS_PATH  "/sys/class/irq_timings"
+#define DEV_PATH    "/dev/irq_timings"
+
+/*
+ * Writes a string to a sysfs file. Returns 0 on success, -1 with errno set
+ * otherwise.
+ */
+static int write_sysfs(const char* path, const char* value)
+{
+    size_t length = strlen(value);
+    ssize_t written;
+    int fd;
+
+    fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    written = write(fd, value, length);
+    close(fd);
+    if (written < 0)
+    {
+        return -1;
+    }
+    if ((size_t) written != length)
+    {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+int irqts_register(unsigned int gpio, const char* options)
+{
+    char input[256];
+
+    if (snprintf(input, sizeof(input), "%u %s", gpio,
+                options != NULL ? options : "") >= (int) sizeof(input))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    return write_sysfs(CLASS_PATH "/register", input);
+}
+
+int irqts_unregister(unsigned int gpio)
+{
+    char input[16];
+
+    snprintf(input, sizeof(input), "%u", gpio);
+    return write_sysfs(CLASS_PATH "/unregister", input);
+}
+
+int irqts_open(struct irqts_pin* pin, unsigned int gpio)
+{
+    struct irqts_ring_header* header;
+    long pageSize = sysconf(_SC_PAGESIZE);
+    char path[64];
+    int saved;
+
+    memset(pin, 0, sizeof(*pin));
+    pin->gpio = gpio;
+    snprintf(path, sizeof(path), DEV_PATH "/gpio%u", gpio);
+    pin->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (pin->fd < 0)
+    {
+        return -1;
+    }
+
+    // the header gives the size of the whole mapping
+    header = mmap(NULL, pageSize, PROT_READ, MAP_SHARED, pin->fd, 0);
+    if (header == MAP_FAILED)
+    {
+        goto Error;
+    }
+    if (header->magic != IRQTS_RING_MAGIC
+            || header->version != IRQTS_RING_VERSION)
+    {
+        munmap(header, pageSize);
+        errno = EPROTO;
+        goto Error;
+    }
+    pin->mapSize = header->data_offset
+            + (size_t) header->capacity * header->entry_size;
+    munmap(header, pageSize);
+
+    header = mmap(NULL, pin->mapSize, PROT_READ, MAP_SHARED, pin->fd, 0);
+    if (header == MAP_FAILED)
+    {
+        goto Error;
+    }
+    pin->header = header;
+    pin->entries = (const char*) header + header->data_offset;
+    pin->position = __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE);
+    return 0;
+
+Error:
+    saved = errno;
+    close(pin->fd);
+    pin->fd = -1;
+    errno = saved;
+    return -1;
+}
+
+void irqts_close(struct irqts_pin* pin)
+{
+    if (pin->header != NULL)
+    {
+        munmap((void*) pin->header, pin->mapSize);
+        pin->header = NULL;
+    }
+    if (pin->fd >= 0)
+    {
+        close(pin->fd);
+        pin->fd = -1;
+    }
+}
+
+size_t irqts_available(const struct irqts_pin* pin)
+{
+    __u32 head = __atomic_load_n(&pin->header->head, __ATOMIC_ACQUIRE);
+    __u32 count = head - pin->position;
+
+    return count < pin->header->capacity ? count : pin->header->capacity;
+}
+
+size_t irqts_next_batch(struct irqts_pin* pin, struct irqts_batch* batch)
+{
+    const struct irqts_ring_header* header = pin->header;
+    // pairs with the release of head by the module
+    __u32 head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+    __u32 index;
+
+    batch->lost = 0;
+    if (head - pin->position > header->capacity)
+    {
+        batch->lost = head - pin->position - header->capacity;
+        pin->position = head - header->capacity;
+    }
+    index = pin->position & (header->capacity - 1);
+    batch->position = pin->position;
+    batch->entrySize = header->entry_size;
+    batch->entries = pin->entries + (size_t) index * header->entry_size;
+    batch->count = head - pin->position;
+    if (batch->count > header->capacity - index)
+    {
+        // the rest follows at the start of the ring
+        batch->count = header->capacity - index;
+    }
+    return batch->count;
+}
+
+int irqts_release(struct irqts_pin* pin, const struct irqts_batch* batch)
+{
+    __u32 head;
+    __u32 position = batch->position + batch->count;
+    int overwritten;
+
+    // the reads of the entries must complete before head is checked
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    head = __atomic_load_n(&pin->header->head, __ATOMIC_RELAXED);
+    overwritten = head - batch->position > pin->header->capacity;
+    if (head - position > pin->header->capacity)
+    {
+        // resynchronise to the oldest entry still in the ring
+        position = head - pin->header->capacity;
+    }
+    pin->position = position;
+
+    // consume even after an overflow, else the watermark stays reached and
+    // irqts_wait returns at once
+    if (position - pin->header->tail <= head - pin->header->tail
+            && ioctl(pin->fd, IRQTS_IOC_CONSUME, &position) < 0)
+    {
+        return -1;
+    }
+    if (overwritten)
+    {
+        errno = EOVERFLOW;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Sets the watermark of a pin. Returns 0 on success, -1 with errno set
+ * otherwise.
+ */
+static int set_watermark(struct irqts_pin* pin, __u32 watermark)
+{
+    char path[96];
+    char value[16];
+
+    snprintf(path, sizeof(path), CLASS_PATH "/pin%u/watermark", pin->gpio);
+    snprintf(value, sizeof(value), "%u", watermark);
+    if (write_sysfs(path, value) < 0)
+    {
+        return -1;
+    }
+    pin->watermark = watermark;
+    return 0;
+}
+
+/*
+ * Returns the CLOCK_MONOTONIC time in nanoseconds.
+ */
+static long long monotonic_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+ssize_t irqts_wait(struct irqts_pin* pin, size_t count, int timeoutMs)
+{
+    struct pollfd pollFd = { .fd = pin->fd, .events = POLLIN };
+    long long deadline = monotonic_ns() + timeoutMs * 1000000LL;
+    long long remaining;
+    size_t available;
+    int status;
+
+    if (count == 0 || count > pin->header->capacity)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (pin->watermark != count && set_watermark(pin, count) < 0)
+    {
+        return -1;
+    }
+
+    for (;;)
+    {
+        available = irqts_available(pin);
+        if (available >= count)
+        {
+            return available;
+        }
+        // signals and spurious wakeups only wait for the rest of the timeout,
+        // which is rounded up so poll does not return before the deadline
+        remaining = -1;
+        if (timeoutMs >= 0)
+        {
+            remaining = deadline - monotonic_ns();
+            remaining = remaining > 0 ? (remaining + 999999) / 1000000 : 0;
+        }
+
+        // the module wakes up pollers relative to the released position
+        status = poll(&pollFd, 1, (int) remaining);
+        if (status < 0)
+        {
+            if (errno != EINTR)
+            {
+                return -1;
+            }
+            continue;
+        }
+        if (pollFd.revents & (POLLHUP | POLLERR))
+        {
+            errno = ENODEV;
+            return -1;
+        }
+        if (status == 0)
+        {
+            return 0;
+        }
+        // a frame ended by an idle gap is returned without waiting for more
+        if (pollFd.revents & POLLIN)
+        {
+            available = irqts_available(pin);
+            if (available > 0)
+            {
+                return available;
+            }
+        }
+    }
+}
+
+/* names of the lines of the stats file, in the order of struct irqts_stats */
+static const char* const stats_names[] = {
+    "captured", "dropped", "overwritten", "gaps", "wakeups", "max_depth",
+    "frames", "frames_dropped", "glitches", "idle_frames", "rejected",
+    "triggers", "storms", "writeback_errors",
+};
+
+int irqts_read_stats(unsigned int gpio, struct irqts_stats* stats)
+{
+    unsigned long* values = (unsigned long*) stats;
+    unsigned long value;
+    char path[96];
+    char name[32];
+    size_t i;
+    FILE* file;
+
+    snprintf(path, sizeof(path), CLASS_PATH "/pin%u/stats", gpio);
+    file = fopen(path, "re");
+    if (file == NULL)
+    {
+        return -1;
+    }
+    memset(stats, 0, sizeof(*stats));
+    // lines unknown to this version of the library are skipped
+    while (fscanf(file, "%31s %lu", name, &value) == 2)
+    {
+        for (i = 0; i < sizeof(stats_names) / sizeof(stats_names[0]); i++)
+        {
+            if (strcmp(name, stats_names[i]) == 0)
+            {
+                values[i] = value;
+                break;
+            }
+        }
+    }
+    fclose(file);
+    return 0;
+}
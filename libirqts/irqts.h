@@ -0,0 +1,169 @@
+/*
+ * irqts.h
+ *
+ * Userspace library consuming the timings of the irq_timings kernel module.
+ * Registers gpio pins, maps their timings ring and iterates over the
+ * captured edges in place, without copies.
+ *
+ * Enlil Odisho
+ * github@enlilodisho.com
+ * October 2021
+ */
+
+#ifndef _IRQTS_H
+#define _IRQTS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "../irq_timings.h"
+
+/* struct representing an open gpio pin with its mapped timings ring */
+struct irqts_pin {
+    unsigned int gpio;
+    int fd;     // /dev/irq_timings/gpio{GPIO_ID}
+    const struct irqts_ring_header* header;
+    const char* entries;
+    size_t mapSize;
+    __u32 position;     // ring position of the next unreleased entry
+    __u32 watermark;    // watermark last set by irqts_wait, 0 if none
+};
+
+/*
+ * struct representing a run of unreleased entries of a pin, pointing into
+ * the mapped ring. Valid until released with irqts_release.
+ */
+struct irqts_batch {
+    const void* entries;
+    size_t count;
+    __u32 position;     // ring position of the first entry
+    __u32 lost;         // entries overwritten before the first entry
+    unsigned int entrySize;     // 4 or 8 bytes, see enum irqts_format
+};
+
+/* capture statistics of a pin, see /sys/class/irq_timings/pin{GPIO_ID}/stats */
+struct irqts_stats {
+    unsigned long captured;
+    unsigned long dropped;
+    unsigned long overwritten;
+    unsigned long gaps;
+    unsigned long wakeups;
+    unsigned long maxDepth;
+    unsigned long frames;
+    unsigned long framesDropped;
+    unsigned long glitches;
+    unsigned long idleFrames;
+    unsigned long rejected;
+    unsigned long triggers;
+    unsigned long storms;
+    unsigned long writebackErrors;
+};
+
+/*
+ * Registers a gpio pin with the module, with options as "name=value ..." or
+ * NULL for the defaults. Returns 0 on success, -1 with errno set otherwise.
+ */
+int irqts_register(unsigned int gpio, const char* options);
+
+/* Unregisters a gpio pin. Returns 0 on success, -1 with errno set otherwise. */
+int irqts_unregister(unsigned int gpio);
+
+/*
+ * Opens a registered gpio pin and maps its ring, starting at the oldest
+ * unread entry. Returns 0 on success, -1 with errno set otherwise.
+ */
+int irqts_open(struct irqts_pin* pin, unsigned int gpio);
+
+/* Unmaps the ring and closes the pin. */
+void irqts_close(struct irqts_pin* pin);
+
+/*
+ * Returns the number of unreleased entries of a pin, at most the ring
+ * capacity.
+ */
+size_t irqts_available(const struct irqts_pin* pin);
+
+/*
+ * Fills batch with the unreleased entries of a pin, up to the end of the
+ * ring, and returns their count, 0 if there are none. Entries overwritten
+ * since the last release are skipped and counted in batch->lost.
+ */
+size_t irqts_next_batch(struct irqts_pin* pin, struct irqts_batch* batch);
+
+/*
+ * Releases the entries of a batch, handing them back to the module so that
+ * watermarks and the drop and stop overflow policies see the room. Returns
+ * 0 on success, or -1 with errno set to EOVERFLOW if the entries were
+ * overwritten while they were used, in which case the batch must be
+ * discarded. The entries are released either way.
+ */
+int irqts_release(struct irqts_pin* pin, const struct irqts_batch* batch);
+
+/*
+ * Waits until at least count entries of a pin are unreleased or a frame
+ * ended by an idle gap is, for at most timeoutMs milliseconds in total,
+ * forever if negative. Signals do not restart the timeout. Sets the
+ * watermark of the pin to count, which affects all its readers. Returns the
+ * number of unreleased entries, 0 on timeout, -1 with errno set on error.
+ * errno is ENODEV once the pin was unregistered.
+ */
+ssize_t irqts_wait(struct irqts_pin* pin, size_t count, int timeoutMs);
+
+/*
+ * Reads the capture statistics of a pin. Returns 0 on success, -1 with
+ * errno set otherwise.
+ */
+int irqts_read_stats(unsigned int gpio, struct irqts_stats* stats);
+
+/* Returns the number of edges of a pin lost before reaching its ring. */
+static inline __u32 irqts_dropped(const struct irqts_pin* pin)
+{
+    return __atomic_load_n(&pin->header->dropped, __ATOMIC_RELAXED);
+}
+
+/* Returns true if entry i of a batch is a drop marker. */
+static inline int irqts_is_drop(const struct irqts_batch* batch, size_t i)
+{
+    if (batch->entrySize == sizeof(__u64))
+    {
+        return ((const __u64*) batch->entries)[i] == IRQTS_DROP64;
+    }
+    return ((const __u32*) batch->entries)[i] == IRQTS_DROP32;
+}
+
+/*
+ * Returns true if entry i of a batch is a capture mode marker of the storm
+ * guard, with the new mode given by irqts_level: 1 for timer sampling, 0
+ * for interrupts.
+ */
+static inline int irqts_is_mode(const struct irqts_batch* batch, size_t i)
+{
+    if (batch->entrySize == sizeof(__u64))
+    {
+        return IRQTS_TIMING64(((const __u64*) batch->entries)[i])
+                == IRQTS_MODE64;
+    }
+    return IRQTS_TIMING32(((const __u32*) batch->entries)[i]) == IRQTS_MODE32;
+}
+
+/* Returns the timing of entry i of a batch, in the unit of its format. */
+static inline __u64 irqts_timing(const struct irqts_batch* batch, size_t i)
+{
+    if (batch->entrySize == sizeof(__u64))
+    {
+        return IRQTS_TIMING64(((const __u64*) batch->entries)[i]);
+    }
+    return IRQTS_TIMING32(((const __u32*) batch->entries)[i]);
+}
+
+/* Returns the level of the line after the edge of entry i of a batch. */
+static inline int irqts_level(const struct irqts_batch* batch, size_t i)
+{
+    if (batch->entrySize == sizeof(__u64))
+    {
+        return (((const __u64*) batch->entries)[i] & IRQTS_LEVEL64) != 0;
+    }
+    return (((const __u32*) batch->entries)[i] & IRQTS_LEVEL32) != 0;
+}
+
+#endif /* _IRQTS_H */
@@ -0,0 +1,312 @@
+/*
+ * irqts_bench.c
+ *
+ * Measures the CPU time the reader paths of the irq_timings module spend per
+ * edge: the sysfs gpio{GPIO_ID} file, read() of the character device with the
+ * raw and packed encodings, and the mapped ring released through
+ * IRQTS_IOC_CONSUME. Each path drains the pin alone for the given seconds,
+ * best while edges are injected through /sys/kernel/debug/irq_timings/bench.
+ *
+ * Usage: irqts_bench GPIO [SECONDS]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "irqts.h"
+
+#define CLASS_PATH  "/sys/class/irq_timings"
+#define READ_SIZE   (64 * 1024)     // bytes per read of every path
+#define WATERMARK   256             // entries unread before readers wake up
+#define IDLE_SLEEP  1000000         // ns slept when the sysfs file is empty
+
+/* reader paths, in the order they run */
+enum {
+    PATH_SYSFS,     // text lines of /sys/class/irq_timings/gpio{GPIO_ID}
+    PATH_READ,      // raw entries from read() of the character device
+    PATH_PACKED,    // packed records from read() of the character device
+    PATH_MMAP,      // entries of the mapped ring, see irqts_next_batch
+    PATHS,
+};
+
+static const char* const path_names[] = {
+    [PATH_SYSFS]    = "sysfs",
+    [PATH_READ]     = "read",
+    [PATH_PACKED]   = "packed",
+    [PATH_MMAP]     = "mmap",
+};
+
+static char buffer[READ_SIZE];
+
+/*
+ * Writes a string to an attribute of a pin. Returns 0 on success, -1 with
+ * errno set otherwise.
+ */
+static int write_attr(unsigned int gpio, const char* name, const char* value)
+{
+    char path[96];
+    ssize_t written;
+    int fd;
+
+    snprintf(path, sizeof(path), CLASS_PATH "/pin%u/%s", gpio, name);
+    fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    written = write(fd, value, strlen(value));
+    close(fd);
+    return written < 0 ? -1 : 0;
+}
+
+/* Returns the CLOCK_MONOTONIC time in nanoseconds. */
+static long long monotonic_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/* Returns the user and system CPU time of the process in nanoseconds. */
+static void cpu_ns(long long* user, long long* sys)
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    *user = usage.ru_utime.tv_sec * 1000000000LL
+            + usage.ru_utime.tv_usec * 1000LL;
+    *sys = usage.ru_stime.tv_sec * 1000000000LL
+            + usage.ru_stime.tv_usec * 1000LL;
+}
+
+/* Returns the ms left until deadline, rounded up, 0 once it passed. */
+static int remaining_ms(long long deadline)
+{
+    long long remaining = deadline - monotonic_ns();
+
+    return remaining > 0 ? (int) ((remaining + 999999) / 1000000) : 0;
+}
+
+/*
+ * Drains the sysfs file of a pin until deadline. The file cannot be polled,
+ * so an empty read sleeps for IDLE_SLEEP. Returns the edges read, -1 with
+ * errno set on error.
+ */
+static long long drain_sysfs(unsigned int gpio, long long deadline)
+{
+    struct timespec idle = { .tv_nsec = IDLE_SLEEP };
+    char path[96];
+    long long edges = 0;
+    ssize_t length;
+    ssize_t i;
+    int fd;
+
+    snprintf(path, sizeof(path), CLASS_PATH "/gpio%u", gpio);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    while (monotonic_ns() < deadline)
+    {
+        // each read at offset 0 takes the next batch of timings
+        length = pread(fd, buffer, sizeof(buffer), 0);
+        if (length < 0)
+        {
+            close(fd);
+            return -1;
+        }
+        if (length == 0)
+        {
+            nanosleep(&idle, NULL);
+            continue;
+        }
+        for (i = 0; i < length; i++)
+        {
+            edges += buffer[i] == '\n';
+        }
+    }
+    close(fd);
+    return edges;
+}
+
+/*
+ * Drains the character device of a pin with read() until deadline, waiting
+ * for the watermark with poll(). Returns the edges read, -1 with errno set
+ * on error.
+ */
+static long long drain_read(struct irqts_pin* pin, int packed,
+        long long deadline)
+{
+    struct pollfd pollFd = { .fd = pin->fd, .events = POLLIN };
+    const struct irqts_packed_header* record =
+            (const struct irqts_packed_header*) buffer;
+    long long edges = 0;
+    ssize_t length;
+    int status;
+
+    while (monotonic_ns() < deadline)
+    {
+        status = poll(&pollFd, 1, remaining_ms(deadline));
+        if (status < 0 && errno != EINTR)
+        {
+            return -1;
+        }
+        if (status <= 0)
+        {
+            continue;
+        }
+        if (pollFd.revents & (POLLHUP | POLLERR))
+        {
+            errno = ENODEV;
+            return -1;
+        }
+        length = read(pin->fd, buffer, sizeof(buffer));
+        if (length < 0)
+        {
+            return -1;
+        }
+        edges += packed ? record->count
+                : (size_t) length / pin->header->entry_size;
+    }
+    return edges;
+}
+
+/*
+ * Drains the mapped ring of a pin until deadline, handing the entries back
+ * through irqts_release. Returns the edges read, -1 with errno set on error.
+ */
+static long long drain_mmap(struct irqts_pin* pin, long long deadline)
+{
+    struct irqts_batch batch;
+    long long edges = 0;
+
+    while (monotonic_ns() < deadline)
+    {
+        if (irqts_wait(pin, WATERMARK, remaining_ms(deadline)) < 0)
+        {
+            return -1;
+        }
+        while (irqts_next_batch(pin, &batch) > 0)
+        {
+            edges += batch.count;
+            // entries overwritten while counted are still counted as read
+            if (irqts_release(pin, &batch) < 0 && errno != EOVERFLOW)
+            {
+                return -1;
+            }
+        }
+    }
+    return edges;
+}
+
+/*
+ * Runs one reader path on a pin for seconds and prints its CPU time per
+ * edge. Returns 0 on success, -1 with errno set otherwise.
+ */
+static int run_path(unsigned int gpio, int path, int seconds)
+{
+    struct irqts_pin pin;
+    struct irqts_stats before;
+    struct irqts_stats after;
+    long long userStart, sysStart;
+    long long userEnd, sysEnd;
+    long long deadline;
+    long long edges;
+    unsigned long lost;
+    char value[16];
+    int saved;
+
+    if (write_attr(gpio, "encoding", path == PATH_PACKED ? "packed" : "raw")
+            < 0)
+    {
+        return -1;
+    }
+    snprintf(value, sizeof(value), "%u", WATERMARK);
+    if (write_attr(gpio, "watermark", value) < 0 || irqts_open(&pin, gpio) < 0)
+    {
+        return -1;
+    }
+    if (irqts_read_stats(gpio, &before) < 0)
+    {
+        goto Error;
+    }
+
+    cpu_ns(&userStart, &sysStart);
+    deadline = monotonic_ns() + seconds * 1000000000LL;
+    switch (path)
+    {
+    case PATH_SYSFS:
+        edges = drain_sysfs(gpio, deadline);
+        break;
+    case PATH_MMAP:
+        edges = drain_mmap(&pin, deadline);
+        break;
+    default:
+        edges = drain_read(&pin, path == PATH_PACKED, deadline);
+        break;
+    }
+    cpu_ns(&userEnd, &sysEnd);
+    if (edges < 0 || irqts_read_stats(gpio, &after) < 0)
+    {
+        goto Error;
+    }
+    irqts_close(&pin);
+
+    lost = (after.dropped - before.dropped)
+            + (after.overwritten - before.overwritten)
+            + (after.rejected - before.rejected);
+    printf("%s %lld %lu %lld %lld %lld\n", path_names[path], edges, lost,
+            edges > 0 ? (userEnd - userStart) / edges : 0,
+            edges > 0 ? (sysEnd - sysStart) / edges : 0,
+            edges > 0 ? (userEnd - userStart + sysEnd - sysStart) / edges : 0);
+    return 0;
+
+Error:
+    saved = errno;
+    irqts_close(&pin);
+    errno = saved;
+    return -1;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int gpio;
+    int seconds = 5;
+    int status = 0;
+    int path;
+
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "usage: %s GPIO [SECONDS]\n", argv[0]);
+        return 1;
+    }
+    gpio = strtoul(argv[1], NULL, 10);
+    if (argc == 3)
+    {
+        seconds = atoi(argv[2]);
+    }
+
+    printf("path edges lost user_ns_per_edge sys_ns_per_edge"
+            " cpu_ns_per_edge\n");
+    for (path = 0; path < PATHS; path++)
+    {
+        if (run_path(gpio, path, seconds) < 0)
+        {
+            // packed reads need the ns format, skip the path otherwise
+            fprintf(stderr, "%s: gpio%u %s: %s\n", argv[0], gpio,
+                    path_names[path], strerror(errno));
+            status = 1;
+        }
+    }
+    write_attr(gpio, "encoding", "raw");
+    return status;
+}